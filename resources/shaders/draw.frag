@@ -2,21 +2,24 @@
 
 uniform sampler2D sampler;
 
-uniform uint objectID;
-uniform uint selectedID;
-
-uniform vec3 diffuseColor;
-uniform vec3 specularColor;
-uniform float shininess;
-
-uniform vec3 ambientLight;
-uniform vec4 lightPositions[10];
-uniform vec3 lightColors[10];
-uniform uint numLights;
+layout (std140) uniform FrameData
+{
+	mat4 projection;
+	vec4 lightPositions[10];
+	vec3 lightColors[10];
+	vec3 ambientLight;
+	uint numLights;
+	uint selectedID;
+	bool packedVertices;
+};
 
 in vec4 fPosition;
 in vec2 fTextureCoord;
 in vec3 fNormal;
+flat in vec3 fDiffuseColor;
+flat in vec3 fSpecularColor;
+flat in float fShininess;
+flat in uint fObjectID;
 
 out vec4 color;
 
@@ -38,15 +41,15 @@ void computeLightEffect(vec4 lightPos, vec3 lightColor, out vec3 diffuseEffect,
 	if (diffuseComponent == 0)
 		specularComponent = 0;
 
-	diffuseEffect = diffuseComponent * diffuseColor * lightColor;
-	specularEffect = specularComponent * specularColor * lightColor;
+	diffuseEffect = diffuseComponent * fDiffuseColor * lightColor;
+	specularEffect = specularComponent * fSpecularColor * lightColor;
 }
 
 void main()
 {
 	vec3 totalDiffuseEffect = vec3(0, 0, 0);
 	vec3 totalSpecularEffect = vec3(0, 0, 0);
-	vec3 ambientEffect = ambientLight * diffuseColor;
+	vec3 ambientEffect = ambientLight * fDiffuseColor;
 	for (uint i = 0u; i < numLights; ++i)
 	{
 		vec3 diffuseEffect;
@@ -58,7 +61,7 @@ void main()
 	
 	vec4 texColor = texture(sampler, fTextureCoord);
 	vec3 highlight = vec3(0, 0, 0);
-	if (objectID == selectedID)
+	if (fObjectID == selectedID)
 		highlight = vec3(0.5, 0, 0.5);
 
 	color.rgb = min(vec3(1), highlight + (ambientEffect + totalDiffuseEffect) * texColor.rgb + totalSpecularEffect);
@@ -3,19 +3,57 @@
 layout (location = 0) in vec4 position;
 layout (location = 1) in vec2 textureCoord;
 layout (location = 2) in vec3 normal;
+layout (location = 3) in mat4 modelview;
+layout (location = 7) in vec3 diffuseColor;
+layout (location = 8) in vec3 specularColor;
+layout (location = 9) in float shininess;
+layout (location = 10) in uint objectID;
 
-uniform mat4 projection;
-uniform mat4 modelview;
+layout (std140) uniform FrameData
+{
+	mat4 projection;
+	vec4 lightPositions[10];
+	vec3 lightColors[10];
+	vec3 ambientLight;
+	uint numLights;
+	uint selectedID;
+	bool packedVertices;
+};
+
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
 
 out vec4 fPosition;
 out vec2 fTextureCoord;
 out vec3 fNormal;
+flat out vec3 fDiffuseColor;
+flat out vec3 fSpecularColor;
+flat out float fShininess;
+flat out uint fObjectID;
+
+vec3 decodeNormal(vec3 n)
+{
+	if (!packedVertices)
+		return n;
+	vec2 e = n.xy / 32767.0;
+	vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (v.z < 0)
+		v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0 ? 1.0 : -1.0, v.y >= 0 ? 1.0 : -1.0);
+	return normalize(v);
+}
+
+invariant gl_Position;
 
 void main()
 {
-	fPosition = modelview * position;
+	vec4 objectPosition = vec4(position.xyz * positionScale + positionOffset, 1.0);
+	fPosition = modelview * objectPosition;
 	fTextureCoord = textureCoord;
-    fNormal = transpose(inverse(mat3(modelview))) * normal;
-	gl_Position = projection * modelview * position;
+    fNormal = transpose(inverse(mat3(modelview))) * decodeNormal(normal);
+	fDiffuseColor = diffuseColor;
+	fSpecularColor = specularColor;
+	fShininess = shininess;
+	fObjectID = objectID;
+	gl_Position = projection * modelview * objectPosition;
 }
 
@@ -3,13 +3,21 @@
 in vec4 fPosition;
 in vec2 fTextureCoord;
 in vec3 fNormal;
+flat in vec3 fDiffuseColor;
+flat in vec3 fSpecularColor;
+flat in float fShininess;
+flat in uint fObjectID;
 
-uniform uint objectID;
-uniform uint selectedID;
-
-uniform vec3 diffuseColor;
-uniform vec3 specularColor;
-uniform float shininess;
+layout (std140) uniform FrameData
+{
+	mat4 projection;
+	vec4 lightPositions[10];
+	vec3 lightColors[10];
+	vec3 ambientLight;
+	uint numLights;
+	uint selectedID;
+	bool packedVertices;
+};
 
 layout (location = 0) out vec4 oPosition;
 layout (location = 1) out vec4 oDiffuse;
@@ -25,7 +33,7 @@ void main()
 {
 	oPosition = fPosition;
 	vec4 highlight = vec4(0, 0, 0, 0);
-	if (objectID == selectedID)
+	if (fObjectID == selectedID)
 		highlight = vec4(0.7, 0, 0.7, 0);
 	oDiffuse = highlight + texture(sampler, fTextureCoord);
     if (!gl_FrontFacing)
@@ -33,7 +41,7 @@ void main()
 	else
 		oNormal = vec4(normalize(fNormal), 1);
 	oTextureCoord = vec4(fTextureCoord, 0.0, 0.0);
-	oDiffuseColor = vec4(diffuseColor, 1);
-	oSpecularColor = vec4(specularColor, 1);
-	oShininess = vec4(vec3(shininess), 1);
+	oDiffuseColor = vec4(fDiffuseColor, 1);
+	oSpecularColor = vec4(fSpecularColor, 1);
+	oShininess = vec4(vec3(fShininess), 1);
 }
@@ -0,0 +1,8 @@
+#version 330
+
+out float count;
+
+void main()
+{
+	count = 1.0;
+}
@@ -0,0 +1,14 @@
+#version 330
+
+uniform sampler2D texCount;
+
+out vec4 color;
+
+void main()
+{
+	// Black where nothing was drawn, then blue, green, yellow and red for
+	// four or more layers
+	const vec3 heat[5] = vec3[5](vec3(0, 0, 0), vec3(0, 0, 1), vec3(0, 1, 0), vec3(1, 1, 0), vec3(1, 0, 0));
+	float count = texelFetch(texCount, ivec2(gl_FragCoord.xy), 0).r;
+	color = vec4(heat[min(int(count), 4)], 1.0);
+}
@@ -1,10 +1,10 @@
 #version 330
 
-uniform uint objectID;
+flat in uint fObjectID;
 
 out uint color;
 
 void main()
 {
-	color = objectID;
+	color = fObjectID;
 }
@@ -1,11 +1,32 @@
 #version 330
 
 layout (location = 0) in vec4 position;
+layout (location = 3) in mat4 modelview;
+layout (location = 10) in uint objectID;
 
-uniform mat4 projection;
-uniform mat4 modelview;
+layout (std140) uniform FrameData
+{
+	mat4 projection;
+	vec4 lightPositions[10];
+	vec3 lightColors[10];
+	vec3 ambientLight;
+	uint numLights;
+	uint selectedID;
+	bool packedVertices;
+};
+
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+
+flat out uint fObjectID;
+
+// The depth pre-pass draws with this shader, and the passes after it test
+// for equal depth
+invariant gl_Position;
 
 void main()
 {
-	gl_Position = projection * modelview * position;
+	vec4 objectPosition = vec4(position.xyz * positionScale + positionOffset, 1.0);
+	gl_Position = projection * modelview * objectPosition;
+	fObjectID = objectID;
 }
@@ -7,13 +7,16 @@ uniform sampler2D texDiffuseColor;
 uniform sampler2D texSpecularColor;
 uniform sampler2D texShininess;
 
-uniform uint objectID;
-uniform uint selectedID;
-
-uniform vec3 ambientLight;
-uniform vec4 lightPositions[10];
-uniform vec3 lightColors[10];
-uniform uint numLights;
+layout (std140) uniform FrameData
+{
+	mat4 projection;
+	vec4 lightPositions[10];
+	vec3 lightColors[10];
+	vec3 ambientLight;
+	uint numLights;
+	uint selectedID;
+	bool packedVertices;
+};
 
 uniform float screenWidth;
 uniform float screenHeight;
@@ -0,0 +1,190 @@
+
+#include "AssetLoader.h"
+#include "MeshOptimizer.h"
+#include "MeshRegistry.h"
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+    double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+AssetLoader::AssetLoader(unsigned int threadCount)
+    : m_threadCount(threadCount), m_parseThreadCount(1), m_manifest(0)
+{
+    if (m_threadCount == 0)
+        m_threadCount = std::max(1u, std::thread::hardware_concurrency());
+}
+
+void AssetLoader::setManifest(const AssetManifest *manifest)
+{
+    m_manifest = manifest;
+}
+
+MeshHandle AssetLoader::addModel(const std::string &filename)
+{
+    MeshHandle mesh = meshes.add(filename);
+
+    Asset asset;
+    asset.type = MODEL_ASSET;
+    asset.name = mesh;
+    asset.filename = filename;
+    asset.texture.pixels = NULL;
+    asset.streamed = false;
+    asset.decodeSeconds = 0;
+    m_assets.push_back(std::move(asset));
+    return mesh;
+}
+
+void AssetLoader::addTexture(unsigned int name, const std::string &filename)
+{
+    Asset asset;
+    asset.type = TEXTURE_ASSET;
+    asset.name = name;
+    asset.filename = filename;
+    asset.texture.pixels = NULL;
+    asset.streamed = false;
+    asset.decodeSeconds = 0;
+    m_assets.push_back(std::move(asset));
+}
+
+void AssetLoader::run()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::atomic<size_t> next(0);
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<size_t> decoded;
+
+    std::vector<std::thread> workers;
+    unsigned int workerCount = std::min<size_t>(m_threadCount, m_assets.size());
+
+    // Workers each parse a file of their own, so splitting files across
+    // more threads would only oversubscribe the cores
+    m_parseThreadCount = workerCount > 1 ? 1 : m_threadCount;
+    for (unsigned int i = 0; i < workerCount; ++i)
+    {
+        workers.push_back(std::thread([&]()
+        {
+            for (size_t index = next++; index < m_assets.size(); index = next++)
+            {
+                decode(m_assets[index]);
+                std::lock_guard<std::mutex> lock(mutex);
+                decoded.push_back(index);
+                ready.notify_one();
+            }
+        }));
+    }
+
+    double decodeSeconds = 0;
+    double uploadSeconds = 0;
+    for (size_t uploaded = 0; uploaded < m_assets.size(); ++uploaded)
+    {
+        size_t index;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [&]() { return !decoded.empty(); });
+            index = decoded.front();
+            decoded.pop_front();
+        }
+
+        Asset &asset = m_assets[index];
+        auto uploadStart = std::chrono::steady_clock::now();
+        upload(asset);
+        double seconds = secondsSince(uploadStart);
+
+        std::ostringstream message;
+        message << "Asset '" << asset.filename << "' decode: " << asset.decodeSeconds * 1000
+                << " ms upload: " << seconds * 1000 << " ms" << std::endl;
+        std::cout << message.str();
+        decodeSeconds += asset.decodeSeconds;
+        uploadSeconds += seconds;
+    }
+
+    for (std::thread &worker : workers)
+        worker.join();
+
+    std::ostringstream message;
+    message << "Loaded " << m_assets.size() << " assets on " << workerCount << " threads in "
+            << secondsSince(start) * 1000 << " ms (decode total: " << decodeSeconds * 1000
+            << " ms, upload total: " << uploadSeconds * 1000 << " ms) peak RSS: "
+            << peakResidentBytes() / (1 << 20) << " MB" << std::endl;
+    std::cout << message.str();
+
+    m_assets.clear();
+}
+
+void AssetLoader::decode(Asset &asset)
+{
+    auto start = std::chrono::steady_clock::now();
+    if (asset.type == MODEL_ASSET)
+    {
+        const std::string *cooked = m_manifest ? m_manifest->findModel(asset.filename) : 0;
+        if (cooked && readCookedMesh(*cooked, asset.filename, asset.cachedMesh))
+            asset.filename = *cooked;
+        else if (!readMeshCache(asset.filename, asset.cachedMesh) && streamingBudget > 0)
+            asset.streamed = true;
+        else if (!asset.cachedMesh.header)
+        {
+            asset.mesh = LoadIndexedOBJ(asset.filename, m_parseThreadCount);
+            optimizeMesh(asset.mesh, asset.filename);
+            generateLods(asset.mesh, asset.filename);
+            writeMeshCache(asset.filename, asset.mesh);
+        }
+
+        if (cpuPicking && asset.cachedMesh.header)
+            buildTriangleBvh(asset.triangles, asset.cachedMesh);
+        else if (cpuPicking && !asset.streamed)
+            buildTriangleBvh(asset.triangles, asset.mesh);
+    }
+    else
+    {
+        const std::string *cooked = m_manifest ? m_manifest->findTexture(asset.filename) : 0;
+        if (cooked && readCookedTexture(*cooked, asset.cookedTexture))
+            asset.filename = *cooked;
+        else
+            asset.texture = decodeTexture(asset.filename);
+    }
+    asset.decodeSeconds = secondsSince(start);
+}
+
+void AssetLoader::upload(Asset &asset)
+{
+    if (asset.type == MODEL_ASSET)
+    {
+        std::swap(meshes[asset.name].triangles, asset.triangles);
+        if (asset.streamed)
+            streamModel(asset.name, asset.filename);
+        else if (asset.cachedMesh.header)
+            uploadModel(asset.name, asset.cachedMesh);
+        else
+            uploadModel(asset.name, asset.mesh);
+        asset.mesh = MeshData();
+        asset.cachedMesh.file.close();
+    }
+    else
+    {
+        if (asset.cookedTexture.header)
+            uploadTexture(asset.name, asset.cookedTexture);
+        else
+        {
+            uploadTexture(asset.name, asset.texture);
+            freeTexture(asset.texture);
+        }
+        asset.cookedTexture.file.close();
+    }
+}
@@ -0,0 +1,66 @@
+
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <string>
+#include <vector>
+
+#include "CookedAssets.h"
+#include "MeshCache.h"
+#include "ObjLoader.h"
+#include "TriangleBvh.h"
+
+// Decodes queued models and textures on a pool of worker threads. run()
+// uploads each asset on the calling thread, which must own the GL context,
+// as soon as its decode finishes.
+class AssetLoader
+{
+public:
+    explicit AssetLoader(unsigned int threadCount = 0);
+
+    // Assets listed in the manifest are loaded from their cooked files
+    // instead of being decoded from source.
+    void setManifest(const AssetManifest *manifest);
+
+    // Registers the model with the mesh registry and returns its handle
+    MeshHandle addModel(const std::string &filename);
+    void addTexture(unsigned int name, const std::string &filename);
+
+    void run();
+
+private:
+    enum AssetType
+    {
+        MODEL_ASSET,
+        TEXTURE_ASSET
+    };
+
+    struct Asset
+    {
+        AssetType type;
+        unsigned int name;
+        std::string filename;
+
+        MeshData mesh;
+        CachedMesh cachedMesh;
+        TextureData texture;
+        CookedTexture cookedTexture;
+
+        // Built with the decode when CPU picking needs it
+        TriangleBvh triangles;
+
+        // Streamed during upload, which owns the GL context
+        bool streamed;
+        double decodeSeconds;
+    };
+
+    void decode(Asset &asset);
+    void upload(Asset &asset);
+
+    unsigned int m_threadCount;
+    unsigned int m_parseThreadCount;    // Given to the OBJ parser by each worker
+    const AssetManifest *m_manifest;
+    std::vector<Asset> m_assets;
+};
+
+#endif
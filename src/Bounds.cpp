@@ -0,0 +1,273 @@
+
+#include "Bounds.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define BOUNDS_SSE 1
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+    inline const gl::Vector3 &positionAt(const gl::Vector3 *positions, size_t i, size_t stride)
+    {
+        return *(const gl::Vector3 *) ((const char *) positions + i * stride);
+    }
+
+    inline unsigned int binIndex(float centroid, float binStart, float binScale)
+    {
+        return std::min<unsigned int>(SahBins::SAH_BIN_COUNT - 1, (unsigned int) ((centroid - binStart) * binScale));
+    }
+}
+
+Bounds::Bounds()
+    : minimum(0, 0, 0), maximum(0, 0, 0), sphere(0, 0, 0, 0)
+{
+}
+
+Bounds computeBounds(const gl::Vector3 *positions, size_t count, size_t stride)
+{
+    Bounds bounds;
+    if (count == 0)
+        return bounds;
+
+    bounds.minimum = bounds.maximum = positions[0];
+    size_t i = 0;
+
+#if BOUNDS_SSE
+    // Four-wide loads read one float past each position, so the last one is
+    // left to the scalar loop
+    if (count > 1)
+    {
+        __m128 minimum = _mm_setr_ps(bounds.minimum[0], bounds.minimum[1], bounds.minimum[2], 0);
+        __m128 maximum = minimum;
+        for (; i + 1 < count; ++i)
+        {
+            __m128 p = _mm_loadu_ps(&positionAt(positions, i, stride)[0]);
+            minimum = _mm_min_ps(minimum, p);
+            maximum = _mm_max_ps(maximum, p);
+        }
+
+        float lanes[4];
+        _mm_storeu_ps(lanes, minimum);
+        bounds.minimum = gl::Vector3(lanes[0], lanes[1], lanes[2]);
+        _mm_storeu_ps(lanes, maximum);
+        bounds.maximum = gl::Vector3(lanes[0], lanes[1], lanes[2]);
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        const gl::Vector3 &p = positionAt(positions, i, stride);
+        for (int c = 0; c < 3; ++c)
+        {
+            bounds.minimum[c] = std::min(bounds.minimum[c], p[c]);
+            bounds.maximum[c] = std::max(bounds.maximum[c], p[c]);
+        }
+    }
+
+    gl::Vector3 center = (bounds.minimum + bounds.maximum) / 2;
+    float radiusSquared = 0;
+    for (i = 0; i < count; ++i)
+    {
+        gl::Vector3 d = positionAt(positions, i, stride) - center;
+        radiusSquared = std::max(radiusSquared, gl::dot(d, d));
+    }
+    bounds.sphere = gl::Vector4(center, std::sqrt(radiusSquared));
+    return bounds;
+}
+
+gl::Matrix4 entityTransform(const Entity &entity)
+{
+    gl::Matrix4 transform;
+    transform.translate(entity.translation);
+    transform.rotate(entity.rotation[1], 0, 1, 0);
+    transform.rotate(entity.rotation[2], 0, 0, 1);
+    transform.rotate(entity.rotation[0], 1, 0, 0);
+    transform.scale(entity.scale);
+    return transform;
+}
+
+Bounds transformBounds(const Bounds &bounds, const gl::Matrix4 &transform)
+{
+    // Arvo: each output extent is the sum of the absolute matrix entries
+    // times the input extents
+    gl::Vector3 center = (bounds.minimum + bounds.maximum) / 2;
+    gl::Vector3 extent = (bounds.maximum - bounds.minimum) / 2;
+    gl::Vector3 worldCenter(transform * gl::Vector4(center, 1));
+
+    Bounds result;
+    for (int row = 0; row < 3; ++row)
+    {
+        float worldExtent = 0;
+        for (int column = 0; column < 3; ++column)
+            worldExtent += std::fabs(transform[column][row]) * extent[column];
+        result.minimum[row] = worldCenter[row] - worldExtent;
+        result.maximum[row] = worldCenter[row] + worldExtent;
+    }
+
+    float maxScale = 0;
+    for (int column = 0; column < 3; ++column)
+        maxScale = std::max(maxScale, gl::Vector3(transform[column]).length());
+
+    gl::Vector3 sphereCenter(transform * gl::Vector4(gl::Vector3(bounds.sphere), 1));
+    result.sphere = gl::Vector4(sphereCenter, bounds.sphere[3] * maxScale);
+    return result;
+}
+
+Bounds transformBounds(const Bounds &bounds, const Entity &entity)
+{
+    return transformBounds(bounds, entityTransform(entity));
+}
+
+BuildBox::BuildBox()
+    : minimum(FLT_MAX, FLT_MAX, FLT_MAX), maximum(-FLT_MAX, -FLT_MAX, -FLT_MAX), count(0)
+{
+}
+
+void BuildBox::grow(const gl::Vector3 &low, const gl::Vector3 &high)
+{
+    for (int c = 0; c < 3; ++c)
+    {
+        minimum[c] = std::min(minimum[c], low[c]);
+        maximum[c] = std::max(maximum[c], high[c]);
+    }
+}
+
+void BuildBox::grow(const BuildBox &box)
+{
+    grow(box.minimum, box.maximum);
+    count += box.count;
+}
+
+float BuildBox::surfaceArea() const
+{
+    gl::Vector3 d = maximum - minimum;
+    if (d[0] < 0)
+        return 0;
+    return 2 * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+}
+
+bool SahSplit::first(const gl::Vector3 &centroid) const
+{
+    return binIndex(centroid[axis], binStart, binScale) <= bin;
+}
+
+SahBins::SahBins(const BuildBox &centroids)
+    : m_centroids(centroids)
+{
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float extent = centroids.maximum[axis] - centroids.minimum[axis];
+        m_binScales[axis] = extent > 0 ? SAH_BIN_COUNT / extent : 0;
+    }
+}
+
+void SahBins::add(const gl::Vector3 &centroid, const gl::Vector3 &minimum, const gl::Vector3 &maximum)
+{
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (m_binScales[axis] == 0)
+            continue;
+
+        BuildBox &bin = m_bins[axis][binIndex(centroid[axis], m_centroids.minimum[axis], m_binScales[axis])];
+        bin.grow(minimum, maximum);
+        bin.count++;
+    }
+}
+
+SahSplit SahBins::split() const
+{
+    SahSplit best = { -1, 0, FLT_MAX, 0, 0 };
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (m_binScales[axis] == 0)
+            continue;
+
+        const BuildBox *bins = m_bins[axis];
+        float rightCosts[SAH_BIN_COUNT];
+        BuildBox right;
+        for (unsigned int b = SAH_BIN_COUNT - 1; b > 0; --b)
+        {
+            right.grow(bins[b]);
+            rightCosts[b] = right.surfaceArea() * right.count;
+        }
+        size_t total = right.count + bins[0].count;
+
+        BuildBox left;
+        for (unsigned int b = 0; b + 1 < SAH_BIN_COUNT; ++b)
+        {
+            left.grow(bins[b]);
+            float cost = left.surfaceArea() * left.count + rightCosts[b + 1];
+            if (left.count > 0 && left.count < total && cost < best.cost)
+            {
+                best.axis = axis;
+                best.bin = b;
+                best.cost = cost;
+                best.binStart = m_centroids.minimum[axis];
+                best.binScale = m_binScales[axis];
+            }
+        }
+    }
+    return best;
+}
+
+Frustum extractFrustum(const gl::Matrix4 &viewProjection)
+{
+    const gl::Matrix4 &m = viewProjection;
+    gl::Vector4 rows[4];
+    for (int row = 0; row < 4; ++row)
+        rows[row] = gl::Vector4(m[0][row], m[1][row], m[2][row], m[3][row]);
+
+    Frustum frustum;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        frustum.planes[axis * 2 + 0] = rows[3] + rows[axis];
+        frustum.planes[axis * 2 + 1] = rows[3] - rows[axis];
+    }
+
+    for (gl::Vector4 &plane : frustum.planes)
+    {
+        float length = gl::Vector3(plane).length();
+        if (length > 0)
+            plane /= length;
+    }
+    return frustum;
+}
+
+FrustumTest classifyBox(const Frustum &frustum, const gl::Vector3 &minimum, const gl::Vector3 &maximum)
+{
+    FrustumTest result = INSIDE_FRUSTUM;
+    for (const gl::Vector4 &plane : frustum.planes)
+    {
+        // Corners furthest along and against the normal
+        gl::Vector3 positive;
+        gl::Vector3 negative;
+        for (int c = 0; c < 3; ++c)
+        {
+            positive[c] = plane[c] >= 0 ? maximum[c] : minimum[c];
+            negative[c] = plane[c] >= 0 ? minimum[c] : maximum[c];
+        }
+
+        gl::Vector3 normal(plane);
+        if (gl::dot(normal, positive) + plane[3] < 0)
+            return OUTSIDE_FRUSTUM;
+        if (gl::dot(normal, negative) + plane[3] < 0)
+            result = INTERSECTS_FRUSTUM;
+    }
+    return result;
+}
+
+bool intersects(const Frustum &frustum, const Bounds &bounds)
+{
+    gl::Vector3 center(bounds.sphere);
+    for (const gl::Vector4 &plane : frustum.planes)
+    {
+        if (gl::dot(gl::Vector3(plane), center) + plane[3] < -bounds.sphere[3])
+            return false;
+    }
+    return classifyBox(frustum, bounds.minimum, bounds.maximum) != OUTSIDE_FRUSTUM;
+}
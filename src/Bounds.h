@@ -0,0 +1,110 @@
+
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include "Util.h"
+
+// Axis-aligned box and bounding sphere of a mesh. The sphere is centred on
+// the box, which is cheap and close enough for culling and level of detail
+// selection.
+struct Bounds
+{
+    Bounds();
+
+    gl::Vector3 minimum;
+    gl::Vector3 maximum;
+    gl::Vector4 sphere;
+};
+
+// Bounds of count positions spaced stride bytes apart, using SSE where
+// available.
+Bounds computeBounds(const gl::Vector3 *positions, size_t count, size_t stride = sizeof(gl::Vector3));
+
+// Object-to-world matrix of an entity: translation, then rotation about y,
+// z and x, then scale
+gl::Matrix4 entityTransform(const Entity &entity);
+
+// Conservative bounds of the transformed box and sphere. The box is exact
+// for the transformed corners; the sphere radius grows by the largest axis
+// scale.
+Bounds transformBounds(const Bounds &bounds, const gl::Matrix4 &transform);
+Bounds transformBounds(const Bounds &bounds, const Entity &entity);
+
+// Box that starts empty and grows to hold what is added to it, counting the
+// additions, for building bounding volume hierarchies
+struct BuildBox
+{
+    BuildBox();
+
+    void grow(const gl::Vector3 &low, const gl::Vector3 &high);
+    void grow(const BuildBox &box);
+
+    // 0 while empty
+    float surfaceArea() const;
+
+    gl::Vector3 minimum;
+    gl::Vector3 maximum;
+    size_t count;
+};
+
+// Boundary between centroid bins chosen by the binned surface area
+// heuristic, with each side costing its surface area times its items
+struct SahSplit
+{
+    int axis;               // -1 when no boundary separates the items
+    unsigned int bin;       // Last bin on the first side
+    float cost;
+    float binStart;         // Centroid bins along axis
+    float binScale;
+
+    // Whether an item with this centroid goes to the first side
+    bool first(const gl::Vector3 &centroid) const;
+};
+
+// Sorts items into SAH_BIN_COUNT bins along each axis of the box around
+// their centroids, then finds the cheapest boundary.
+class SahBins
+{
+public:
+    enum { SAH_BIN_COUNT = 16 };
+
+    explicit SahBins(const BuildBox &centroids);
+
+    void add(const gl::Vector3 &centroid, const gl::Vector3 &minimum, const gl::Vector3 &maximum);
+
+    // A split that leaves a side empty is never chosen
+    SahSplit split() const;
+
+private:
+    BuildBox m_centroids;
+    float m_binScales[3];       // 0 along axes where the centroids are flat
+    BuildBox m_bins[3][SAH_BIN_COUNT];
+};
+
+// Inward-facing planes (a, b, c, d) with ax + by + cz + d >= 0 inside, in
+// the order left, right, bottom, top, near, far.
+struct Frustum
+{
+    gl::Vector4 planes[6];
+};
+
+// Gribb-Hartmann extraction from a projection * view matrix. The planes are
+// in the space that matrix transforms from.
+Frustum extractFrustum(const gl::Matrix4 &viewProjection);
+
+enum FrustumTest
+{
+    OUTSIDE_FRUSTUM,
+    INTERSECTS_FRUSTUM,
+    INSIDE_FRUSTUM
+};
+
+// Conservative classification of a box: boxes reported as intersecting may
+// still be outside near the frustum's corners.
+FrustumTest classifyBox(const Frustum &frustum, const gl::Vector3 &minimum, const gl::Vector3 &maximum);
+
+// False only when the bounds are certainly outside: the sphere is tested
+// first, then the box against each plane.
+bool intersects(const Frustum &frustum, const Bounds &bounds);
+
+#endif
@@ -0,0 +1,180 @@
+
+#include "CookedAssets.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+    const char MAGIC[4] = { 'T', 'E', 'X', 'C' };
+
+    // Halves an RGBA8 image with a box filter. Odd edges reuse the last
+    // row or column.
+    std::vector<unsigned char> downsample(const unsigned char *pixels, int width, int height, int &outWidth, int &outHeight)
+    {
+        outWidth = width > 1 ? width / 2 : 1;
+        outHeight = height > 1 ? height / 2 : 1;
+
+        std::vector<unsigned char> out((size_t) outWidth * outHeight * 4);
+        for (int y = 0; y < outHeight; ++y)
+        {
+            int y0 = std::min(y * 2, height - 1);
+            int y1 = std::min(y * 2 + 1, height - 1);
+            for (int x = 0; x < outWidth; ++x)
+            {
+                int x0 = std::min(x * 2, width - 1);
+                int x1 = std::min(x * 2 + 1, width - 1);
+                for (int c = 0; c < 4; ++c)
+                {
+                    int sum = pixels[((size_t) y0 * width + x0) * 4 + c] +
+                              pixels[((size_t) y0 * width + x1) * 4 + c] +
+                              pixels[((size_t) y1 * width + x0) * 4 + c] +
+                              pixels[((size_t) y1 * width + x1) * 4 + c];
+                    out[((size_t) y * outWidth + x) * 4 + c] = (unsigned char) ((sum + 2) / 4);
+                }
+            }
+        }
+        return out;
+    }
+}
+
+bool readCookedTexture(const std::string &filename, CookedTexture &texture)
+{
+    if (!texture.file.open(filename) || texture.file.size() < sizeof(TextureFileHeader))
+        return false;
+
+    const TextureFileHeader *header = (const TextureFileHeader *) texture.file.data();
+    if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header->version != TEXTURE_FILE_VERSION ||
+        header->levels == 0 || header->levels > MAX_TEXTURE_LEVELS)
+    {
+        texture.file.close();
+        return false;
+    }
+
+    size_t offset = sizeof(TextureFileHeader);
+    int width = header->width;
+    int height = header->height;
+    for (unsigned int level = 0; level < header->levels; ++level)
+    {
+        texture.levels[level] = (const unsigned char *) texture.file.data() + offset;
+        texture.levelWidth[level] = width;
+        texture.levelHeight[level] = height;
+        offset += (size_t) width * height * 4;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+
+    if (offset != texture.file.size())
+    {
+        texture.file.close();
+        return false;
+    }
+
+    texture.header = header;
+    texture.levelCount = header->levels;
+    return true;
+}
+
+bool writeCookedTexture(const std::string &filename, const TextureData &texture)
+{
+    TextureFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = TEXTURE_FILE_VERSION;
+    header.width = texture.width;
+    header.height = texture.height;
+    header.components = texture.components;
+
+    std::vector<std::vector<unsigned char> > levels;
+    levels.push_back(std::vector<unsigned char>(texture.pixels, texture.pixels + (size_t) texture.width * texture.height * 4));
+    int width = texture.width;
+    int height = texture.height;
+    while ((width > 1 || height > 1) && levels.size() < MAX_TEXTURE_LEVELS)
+    {
+        int nextWidth, nextHeight;
+        levels.push_back(downsample(&levels.back()[0], width, height, nextWidth, nextHeight));
+        width = nextWidth;
+        height = nextHeight;
+    }
+    header.levels = (uint32_t) levels.size();
+
+    std::string temporary = filename + ".tmp";
+    FILE *out = fopen(temporary.c_str(), "wb");
+    if (!out)
+        return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    for (const std::vector<unsigned char> &level : levels)
+        ok = ok && fwrite(&level[0], 1, level.size(), out) == level.size();
+    ok = fclose(out) == 0 && ok;
+#if _WIN32
+    remove(filename.c_str());
+#endif
+
+    if (!ok || rename(temporary.c_str(), filename.c_str()) != 0)
+    {
+        remove(temporary.c_str());
+        std::cerr << "Could not write cooked texture '" << filename << "'" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool AssetManifest::load(const std::string &filename)
+{
+    std::ifstream in(filename);
+    if (!in)
+        return false;
+
+    std::string type, source, cooked;
+    while (in >> type >> source >> cooked)
+    {
+        if (type == "model")
+            addModel(source, cooked);
+        else if (type == "texture")
+            addTexture(source, cooked);
+    }
+
+    return true;
+}
+
+bool AssetManifest::save(const std::string &filename) const
+{
+    std::ofstream out(filename);
+    if (!out)
+        return false;
+
+    for (auto &entry : m_models)
+        out << "model " << entry.first << " " << entry.second << std::endl;
+    for (auto &entry : m_textures)
+        out << "texture " << entry.first << " " << entry.second << std::endl;
+
+    return bool(out);
+}
+
+void AssetManifest::addModel(const std::string &source, const std::string &cooked)
+{
+    m_models[source] = cooked;
+}
+
+void AssetManifest::addTexture(const std::string &source, const std::string &cooked)
+{
+    m_textures[source] = cooked;
+}
+
+const std::string *AssetManifest::findModel(const std::string &source) const
+{
+    auto entry = m_models.find(source);
+    return entry == m_models.end() ? 0 : &entry->second;
+}
+
+const std::string *AssetManifest::findTexture(const std::string &source) const
+{
+    auto entry = m_textures.find(source);
+    return entry == m_textures.end() ? 0 : &entry->second;
+}
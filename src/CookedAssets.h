@@ -0,0 +1,63 @@
+
+#ifndef COOKED_ASSETS_H
+#define COOKED_ASSETS_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Util.h"
+
+// Pre-decoded RGBA8 texture with its full mip chain. The header is followed
+// by the pixels of every level, largest first, tightly packed.
+struct TextureFileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levels;
+    uint32_t components;
+};
+
+enum { TEXTURE_FILE_VERSION = 1 };
+enum { MAX_TEXTURE_LEVELS = 16 };
+
+struct CookedTexture
+{
+    CookedTexture() : header(0), levelCount(0) {}
+
+    MappedFile file;
+    const TextureFileHeader *header;
+    unsigned int levelCount;
+    const unsigned char *levels[MAX_TEXTURE_LEVELS];
+    int levelWidth[MAX_TEXTURE_LEVELS];
+    int levelHeight[MAX_TEXTURE_LEVELS];
+};
+
+bool readCookedTexture(const std::string &filename, CookedTexture &texture);
+bool writeCookedTexture(const std::string &filename, const TextureData &texture);
+
+// Maps source asset paths to their cooked counterparts. The manifest is a
+// text file with one "model|texture <source> <cooked>" entry per line.
+class AssetManifest
+{
+public:
+    bool load(const std::string &filename);
+    bool save(const std::string &filename) const;
+
+    void addModel(const std::string &source, const std::string &cooked);
+    void addTexture(const std::string &source, const std::string &cooked);
+
+    const std::string *findModel(const std::string &source) const;
+    const std::string *findTexture(const std::string &source) const;
+
+    bool empty() const { return m_models.empty() && m_textures.empty(); }
+
+private:
+    std::map<std::string, std::string> m_models;
+    std::map<std::string, std::string> m_textures;
+};
+
+#endif
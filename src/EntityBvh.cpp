@@ -0,0 +1,243 @@
+
+#include "EntityBvh.h"
+#include "MeshRegistry.h"
+
+#include <algorithm>
+#include <cfloat>
+
+namespace
+{
+    const GLuint NO_NODE = ~0u;
+    const GLuint MAX_LEAF_ITEMS = 8;
+
+    gl::Vector3 centroid(const Bounds &bounds)
+    {
+        return (bounds.minimum + bounds.maximum) / 2;
+    }
+
+    // Slab test. Returns the entry distance, or a negative value on a miss.
+    float intersectBox(const gl::Vector3 &origin, const gl::Vector3 &inverse, const gl::Vector3 &minimum, const gl::Vector3 &maximum)
+    {
+        float enter = 0;
+        float leave = FLT_MAX;
+        for (int c = 0; c < 3; ++c)
+        {
+            float t0 = (minimum[c] - origin[c]) * inverse[c];
+            float t1 = (maximum[c] - origin[c]) * inverse[c];
+            enter = std::max(enter, std::min(t0, t1));
+            leave = std::min(leave, std::max(t0, t1));
+        }
+        return enter <= leave ? enter : -1;
+    }
+}
+
+EntityBvh::EntityBvh()
+{
+}
+
+void EntityBvh::build(const std::vector<Entity> &entities)
+{
+    m_bounds.resize(entities.size());
+    m_items.resize(entities.size());
+    m_leaves.assign(entities.size(), NO_NODE);
+    for (size_t i = 0; i < entities.size(); ++i)
+    {
+        m_bounds[i] = transformBounds(meshes[entities[i].mesh].bounds, entities[i]);
+        m_items[i] = (GLuint) i;
+    }
+
+    m_nodes.clear();
+    m_parents.clear();
+    if (entities.empty())
+        return;
+
+    m_nodes.reserve(2 * entities.size());
+    m_parents.reserve(2 * entities.size());
+    m_nodes.push_back(Node());
+    m_parents.push_back(NO_NODE);
+    split(0, 0, (GLuint) entities.size());
+}
+
+void EntityBvh::split(GLuint node, GLuint first, GLuint count)
+{
+    m_nodes[node].first = first;
+    m_nodes[node].count = count;
+    fit(node);
+    if (count <= 2)
+    {
+        for (GLuint i = first; i < first + count; ++i)
+            m_leaves[m_items[i]] = node;
+        return;
+    }
+
+    BuildBox centroids;
+    for (GLuint i = first; i < first + count; ++i)
+    {
+        gl::Vector3 c = centroid(m_bounds[m_items[i]]);
+        centroids.grow(c, c);
+    }
+
+    // Cheapest boundary between bins along any axis, counting the cost of
+    // each side as its surface area times its entities
+    SahBins bins(centroids);
+    for (GLuint i = first; i < first + count; ++i)
+    {
+        const Bounds &bounds = m_bounds[m_items[i]];
+        bins.add(centroid(bounds), bounds.minimum, bounds.maximum);
+    }
+    SahSplit best = bins.split();
+
+    BuildBox box;
+    box.grow(m_nodes[node].minimum, m_nodes[node].maximum);
+    float leafCost = box.surfaceArea() * count;
+    if (count <= MAX_LEAF_ITEMS && (best.axis < 0 || best.cost >= leafCost))
+    {
+        for (GLuint i = first; i < first + count; ++i)
+            m_leaves[m_items[i]] = node;
+        return;
+    }
+
+    // Identical centroids: split by count
+    GLuint middle = first + count / 2;
+    if (best.axis >= 0)
+    {
+        GLuint *boundary = std::partition(&m_items[first], &m_items[first] + count, [&](GLuint item)
+        {
+            return best.first(centroid(m_bounds[item]));
+        });
+        middle = (GLuint) (boundary - &m_items[0]);
+    }
+
+    GLuint children = (GLuint) m_nodes.size();
+    m_nodes.push_back(Node());
+    m_nodes.push_back(Node());
+    m_parents.push_back(node);
+    m_parents.push_back(node);
+    m_nodes[node].first = children;
+    m_nodes[node].count = 0;
+    split(children, first, middle - first);
+    split(children + 1, middle, first + count - middle);
+}
+
+void EntityBvh::fit(GLuint node)
+{
+    Node &n = m_nodes[node];
+    BuildBox box;
+    if (n.count)
+    {
+        for (GLuint i = n.first; i < n.first + n.count; ++i)
+            box.grow(m_bounds[m_items[i]].minimum, m_bounds[m_items[i]].maximum);
+    }
+    else
+    {
+        box.grow(m_nodes[n.first].minimum, m_nodes[n.first].maximum);
+        box.grow(m_nodes[n.first + 1].minimum, m_nodes[n.first + 1].maximum);
+    }
+    n.minimum = box.minimum;
+    n.maximum = box.maximum;
+}
+
+void EntityBvh::refit(size_t index, const Entity &entity)
+{
+    m_bounds[index] = transformBounds(meshes[entity.mesh].bounds, entity);
+    for (GLuint node = m_leaves[index]; node != NO_NODE; node = m_parents[node])
+        fit(node);
+}
+
+void EntityBvh::refit(const std::vector<Entity> &entities)
+{
+    for (size_t i = 0; i < m_bounds.size(); ++i)
+        m_bounds[i] = transformBounds(meshes[entities[i].mesh].bounds, entities[i]);
+
+    // Children always come after their parent
+    for (size_t node = m_nodes.size(); node-- > 0;)
+        fit((GLuint) node);
+}
+
+void EntityBvh::cull(const Frustum &frustum, std::vector<GLuint> &visible) const
+{
+    visible.clear();
+    if (m_nodes.empty())
+        return;
+
+    std::vector<GLuint> stack(1, 0);
+    while (!stack.empty())
+    {
+        GLuint node = stack.back();
+        stack.pop_back();
+        const Node &n = m_nodes[node];
+        FrustumTest test = classifyBox(frustum, n.minimum, n.maximum);
+        if (test == OUTSIDE_FRUSTUM)
+            continue;
+
+        if (test == INSIDE_FRUSTUM)
+            addSubtree(node, visible);
+        else if (n.count)
+        {
+            for (GLuint i = n.first; i < n.first + n.count; ++i)
+            {
+                if (intersects(frustum, m_bounds[m_items[i]]))
+                    visible.push_back(m_items[i]);
+            }
+        }
+        else
+        {
+            stack.push_back(n.first);
+            stack.push_back(n.first + 1);
+        }
+    }
+    std::sort(visible.begin(), visible.end());
+}
+
+void EntityBvh::addSubtree(GLuint node, std::vector<GLuint> &visible) const
+{
+    const Node &n = m_nodes[node];
+    if (n.count)
+        visible.insert(visible.end(), &m_items[n.first], &m_items[n.first] + n.count);
+    else
+    {
+        addSubtree(n.first, visible);
+        addSubtree(n.first + 1, visible);
+    }
+}
+
+void EntityBvh::intersectRay(const gl::Vector3 &origin, const gl::Vector3 &direction, std::vector<RayHit> &hits) const
+{
+    hits.clear();
+    if (m_nodes.empty())
+        return;
+
+    gl::Vector3 inverse(1 / direction[0], 1 / direction[1], 1 / direction[2]);
+    std::vector<GLuint> stack(1, 0);
+    while (!stack.empty())
+    {
+        const Node &n = m_nodes[stack.back()];
+        stack.pop_back();
+        if (intersectBox(origin, inverse, n.minimum, n.maximum) < 0)
+            continue;
+
+        if (n.count)
+        {
+            for (GLuint i = n.first; i < n.first + n.count; ++i)
+            {
+                const Bounds &bounds = m_bounds[m_items[i]];
+                float distance = intersectBox(origin, inverse, bounds.minimum, bounds.maximum);
+                if (distance >= 0)
+                {
+                    RayHit hit = { m_items[i], distance };
+                    hits.push_back(hit);
+                }
+            }
+        }
+        else
+        {
+            stack.push_back(n.first);
+            stack.push_back(n.first + 1);
+        }
+    }
+
+    std::sort(hits.begin(), hits.end(), [](const RayHit &a, const RayHit &b)
+    {
+        return a.distance < b.distance || (a.distance == b.distance && a.entity < b.entity);
+    });
+}
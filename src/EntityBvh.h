@@ -0,0 +1,66 @@
+
+#ifndef ENTITY_BVH_H
+#define ENTITY_BVH_H
+
+#include <vector>
+
+#include "Bounds.h"
+#include "Util.h"
+
+struct RayHit
+{
+    GLuint entity;      // Index into the entity list
+    float distance;     // Where the ray enters the entity's box, in multiples of its direction
+};
+
+// Bounding volume hierarchy over the world bounds of a list of entities,
+// built with a binned surface area heuristic. Refitting only updates boxes,
+// so the tree stays correct as entities move but slowly loses quality;
+// rebuild it after large edits.
+class EntityBvh
+{
+public:
+    EntityBvh();
+
+    void build(const std::vector<Entity> &entities);
+
+    // Updates the bounds of one entity and the nodes above it
+    void refit(size_t index, const Entity &entity);
+
+    // Updates the bounds of every entity and every node
+    void refit(const std::vector<Entity> &entities);
+
+    // Indices of the entities that may be inside the frustum, in ascending
+    // order
+    void cull(const Frustum &frustum, std::vector<GLuint> &visible) const;
+
+    // Entities whose boxes the ray hits, nearest first
+    void intersectRay(const gl::Vector3 &origin, const gl::Vector3 &direction, std::vector<RayHit> &hits) const;
+
+    size_t size() const { return m_bounds.size(); }
+    size_t nodeCount() const { return m_nodes.size(); }
+    const Bounds &bounds(size_t index) const { return m_bounds[index]; }
+
+private:
+    // Leaves have a count and hold m_items[first, first + count); inner
+    // nodes have their two children at first and first + 1.
+    struct Node
+    {
+        gl::Vector3 minimum;
+        gl::Vector3 maximum;
+        GLuint first;
+        GLuint count;
+    };
+
+    void split(GLuint node, GLuint first, GLuint count);
+    void fit(GLuint node);
+    void addSubtree(GLuint node, std::vector<GLuint> &visible) const;
+
+    std::vector<Node> m_nodes;
+    std::vector<GLuint> m_parents;
+    std::vector<GLuint> m_items;    // Entity indices grouped by leaf
+    std::vector<GLuint> m_leaves;   // Leaf holding each entity
+    std::vector<Bounds> m_bounds;   // World bounds of each entity
+};
+
+#endif
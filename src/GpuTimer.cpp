@@ -0,0 +1,58 @@
+#include "GpuTimer.h"
+
+GpuTimer::GpuTimer()
+    : m_next(0), m_milliseconds(-1)
+{
+    for (unsigned int i = 0; i < QUERY_COUNT; ++i)
+    {
+        m_queries[i][0] = m_queries[i][1] = 0;
+        m_pending[i] = false;
+    }
+}
+
+void GpuTimer::begin()
+{
+    if (!m_queries[0][0])
+        glGenQueries(QUERY_COUNT * 2, &m_queries[0][0]);
+
+    // Only when every slot is still in flight does the oldest result have
+    // to be waited for
+    milliseconds();
+    if (m_pending[m_next])
+        collect(m_next);
+    glQueryCounter(m_queries[m_next][0], GL_TIMESTAMP);
+}
+
+void GpuTimer::end()
+{
+    glQueryCounter(m_queries[m_next][1], GL_TIMESTAMP);
+    m_pending[m_next] = true;
+    m_next = (m_next + 1) % QUERY_COUNT;
+}
+
+double GpuTimer::milliseconds()
+{
+    // Oldest first, so the last result read is the newest
+    for (unsigned int i = 0; i < QUERY_COUNT; ++i)
+    {
+        unsigned int slot = (m_next + i) % QUERY_COUNT;
+        if (!m_pending[slot])
+            continue;
+
+        GLint available;
+        glGetQueryObjectiv(m_queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+        collect(slot);
+    }
+    return m_milliseconds;
+}
+
+void GpuTimer::collect(unsigned int slot)
+{
+    GLuint64 start, stop;
+    glGetQueryObjectui64v(m_queries[slot][0], GL_QUERY_RESULT, &start);
+    glGetQueryObjectui64v(m_queries[slot][1], GL_QUERY_RESULT, &stop);
+    m_milliseconds = (stop - start) / 1e6;
+    m_pending[slot] = false;
+}
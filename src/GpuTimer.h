@@ -0,0 +1,33 @@
+
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include "Util.h"
+
+// Measures how long the GPU takes for the commands between begin() and
+// end() with a pair of timestamp queries, so timers may be nested. Results
+// are collected a few frames late, once they are available, so reading
+// them does not stall.
+class GpuTimer
+{
+public:
+    GpuTimer();
+
+    void begin();
+    void end();
+
+    // Most recent result, or a negative value until the first one arrives
+    double milliseconds();
+
+private:
+    enum { QUERY_COUNT = 4 };
+
+    void collect(unsigned int slot);
+
+    GLuint m_queries[QUERY_COUNT][2];
+    bool m_pending[QUERY_COUNT];
+    unsigned int m_next;
+    double m_milliseconds;
+};
+
+#endif
@@ -277,6 +277,54 @@ namespace gl
         }
     }
 
+    bool Matrix4::invert()
+    {
+        // Cofactors from the 2x2 minors of the top and bottom two rows
+        Matrix4& M = (*this);
+        float s0 = M[0][0] * M[1][1] - M[0][1] * M[1][0];
+        float s1 = M[0][0] * M[2][1] - M[0][1] * M[2][0];
+        float s2 = M[0][0] * M[3][1] - M[0][1] * M[3][0];
+        float s3 = M[1][0] * M[2][1] - M[1][1] * M[2][0];
+        float s4 = M[1][0] * M[3][1] - M[1][1] * M[3][0];
+        float s5 = M[2][0] * M[3][1] - M[2][1] * M[3][0];
+
+        float c0 = M[0][2] * M[1][3] - M[0][3] * M[1][2];
+        float c1 = M[0][2] * M[2][3] - M[0][3] * M[2][2];
+        float c2 = M[0][2] * M[3][3] - M[0][3] * M[3][2];
+        float c3 = M[1][2] * M[2][3] - M[1][3] * M[2][2];
+        float c4 = M[1][2] * M[3][3] - M[1][3] * M[3][2];
+        float c5 = M[2][2] * M[3][3] - M[2][3] * M[3][2];
+
+        float det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+        if (det == 0)
+            return false;
+
+        Matrix4 I;
+        I[0][0] =  M[1][1] * c5 - M[2][1] * c4 + M[3][1] * c3;
+        I[1][0] = -M[1][0] * c5 + M[2][0] * c4 - M[3][0] * c3;
+        I[2][0] =  M[1][3] * s5 - M[2][3] * s4 + M[3][3] * s3;
+        I[3][0] = -M[1][2] * s5 + M[2][2] * s4 - M[3][2] * s3;
+
+        I[0][1] = -M[0][1] * c5 + M[2][1] * c2 - M[3][1] * c1;
+        I[1][1] =  M[0][0] * c5 - M[2][0] * c2 + M[3][0] * c1;
+        I[2][1] = -M[0][3] * s5 + M[2][3] * s2 - M[3][3] * s1;
+        I[3][1] =  M[0][2] * s5 - M[2][2] * s2 + M[3][2] * s1;
+
+        I[0][2] =  M[0][1] * c4 - M[1][1] * c2 + M[3][1] * c0;
+        I[1][2] = -M[0][0] * c4 + M[1][0] * c2 - M[3][0] * c0;
+        I[2][2] =  M[0][3] * s4 - M[1][3] * s2 + M[3][3] * s0;
+        I[3][2] = -M[0][2] * s4 + M[1][2] * s2 - M[3][2] * s0;
+
+        I[0][3] = -M[0][1] * c3 + M[1][1] * c1 - M[2][1] * c0;
+        I[1][3] =  M[0][0] * c3 - M[1][0] * c1 + M[2][0] * c0;
+        I[2][3] = -M[0][3] * s3 + M[1][3] * s1 - M[2][3] * s0;
+        I[3][3] =  M[0][2] * s3 - M[1][2] * s1 + M[2][2] * s0;
+
+        for (int col = 0; col < 4; ++col)
+            M[col] = I[col] / det;
+        return true;
+    }
+
     void Matrix4::loadIdentity()
     {
         m_columns[0] = Vector4(1, 0, 0, 0);
@@ -93,6 +93,9 @@ namespace gl
 
         void transpose();
 
+        // Leaves the matrix unchanged and returns false if it is singular
+        bool invert();
+
         void loadIdentity();
 
         void translate(float x, float y, float z);
@@ -0,0 +1,224 @@
+
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <sys/stat.h>
+
+namespace
+{
+    const char MAGIC[4] = { 'M', 'S', 'H', 'C' };
+
+    bool sourceInfo(const std::string &filename, uint64_t &size, int64_t &modifiedTime)
+    {
+        struct stat info;
+        if (stat(filename.c_str(), &info) != 0)
+            return false;
+        size = (uint64_t) info.st_size;
+        modifiedTime = (int64_t) info.st_mtime;
+        return true;
+    }
+
+    bool matchesSource(const CachedMesh &mesh, uint64_t size, int64_t modifiedTime)
+    {
+        return mesh.header->sourceSize == size && mesh.header->sourceModifiedTime == modifiedTime;
+    }
+
+    template <class Index>
+    bool indicesInRange(const void *indices, size_t count, size_t vertexCount)
+    {
+        Index largest = 0;
+        for (size_t i = 0; i < count; ++i)
+            largest = std::max(largest, ((const Index *) indices)[i]);
+        return largest < vertexCount;
+    }
+}
+
+std::string meshCacheFilename(const std::string &sourceFilename)
+{
+    return sourceFilename + ".mesh";
+}
+
+bool readMeshCache(const std::string &sourceFilename, CachedMesh &mesh)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    uint64_t size;
+    int64_t modifiedTime;
+    if (!sourceInfo(sourceFilename, size, modifiedTime))
+        return false;
+
+    if (!readMeshFile(meshCacheFilename(sourceFilename), mesh))
+        return false;
+
+    if (!matchesSource(mesh, size, modifiedTime))
+    {
+        mesh.file.close();
+        mesh.header = 0;
+        return false;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::ostringstream message;
+    message << "Loaded Cached Model '" << meshCacheFilename(sourceFilename) << "' vertices: " << mesh.header->vertexCount
+            << " indices: " << mesh.header->indexCount << " time: " << seconds * 1000 << " ms" << std::endl;
+    std::cout << message.str();
+
+    return true;
+}
+
+bool readCookedMesh(const std::string &cookedFilename, const std::string &sourceFilename, CachedMesh &mesh)
+{
+    if (!readMeshFile(cookedFilename, mesh))
+        return false;
+
+    uint64_t size;
+    int64_t modifiedTime;
+    if (sourceInfo(sourceFilename, size, modifiedTime) && !matchesSource(mesh, size, modifiedTime))
+    {
+        std::cerr << "Cooked mesh '" << cookedFilename << "' is older than '" << sourceFilename << "'" << std::endl;
+        mesh.file.close();
+        mesh.header = 0;
+        return false;
+    }
+    return true;
+}
+
+bool writeMeshCache(const std::string &sourceFilename, const MeshData &mesh)
+{
+    uint64_t size;
+    int64_t modifiedTime;
+    if (!sourceInfo(sourceFilename, size, modifiedTime))
+        return false;
+
+    return writeMeshFile(meshCacheFilename(sourceFilename), mesh, size, modifiedTime);
+}
+
+bool readMeshFile(const std::string &filename, CachedMesh &mesh)
+{
+    if (!mesh.file.open(filename) || mesh.file.size() < sizeof(MeshCacheHeader))
+        return false;
+
+    const MeshCacheHeader *header = (const MeshCacheHeader *) mesh.file.data();
+    if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header->version != MESH_CACHE_VERSION ||
+        header->vertexLayout != VERTEX_LAYOUT_FLOAT ||
+        header->vertexStride != sizeof(Vertex) ||
+        (header->indexType != GL_UNSIGNED_SHORT && header->indexType != GL_UNSIGNED_INT))
+    {
+        mesh.file.close();
+        return false;
+    }
+
+    size_t vertexBytes = (size_t) header->vertexCount * header->vertexStride;
+    size_t indexBytes = (size_t) header->indexCount * indexSize(header->indexType);
+    if (header->indexCount == 0 || mesh.file.size() != sizeof(MeshCacheHeader) + vertexBytes + indexBytes ||
+        header->lodCount == 0 || header->lodCount > MAX_MESH_LODS)
+    {
+        mesh.file.close();
+        return false;
+    }
+
+    for (unsigned int i = 0; i < header->lodCount; ++i)
+    {
+        if (header->lods[i].indexOffset > header->indexCount ||
+            header->lods[i].indexCount > header->indexCount - header->lods[i].indexOffset)
+        {
+            mesh.file.close();
+            return false;
+        }
+    }
+
+    // Indices past the vertices would read out of bounds on the CPU and draw
+    // garbage on the GPU
+    const char *indices = mesh.file.data() + sizeof(MeshCacheHeader) + vertexBytes;
+    bool inRange = header->indexType == GL_UNSIGNED_SHORT
+        ? indicesInRange<GLushort>(indices, header->indexCount, header->vertexCount)
+        : indicesInRange<GLuint>(indices, header->indexCount, header->vertexCount);
+    if (!inRange)
+    {
+        mesh.file.close();
+        return false;
+    }
+
+    mesh.header = header;
+    mesh.vertices = (const Vertex *) (mesh.file.data() + sizeof(MeshCacheHeader));
+    mesh.indices = indices;
+
+    return true;
+}
+
+bool writeMeshFile(const std::string &filename, const MeshData &mesh, uint64_t sourceSize, int64_t sourceModifiedTime)
+{
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = MESH_CACHE_VERSION;
+    header.vertexLayout = VERTEX_LAYOUT_FLOAT;
+    header.vertexStride = sizeof(Vertex);
+    header.vertexCount = (uint32_t) mesh.vertices.size();
+    header.indexCount = (uint32_t) mesh.indices.size();
+    header.indexType = indexType(mesh.vertices.size());
+    header.sourceSize = sourceSize;
+    header.sourceModifiedTime = sourceModifiedTime;
+
+    if (mesh.lods.empty())
+    {
+        header.lodCount = 1;
+        header.lods[0].indexCount = header.indexCount;
+    }
+    else
+    {
+        header.lodCount = (uint32_t) std::min<size_t>(mesh.lods.size(), MAX_MESH_LODS);
+        std::copy(mesh.lods.begin(), mesh.lods.begin() + header.lodCount, header.lods);
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        header.boundsMin[i] = mesh.vertices.empty() ? 0 : mesh.vertices[0].position[i];
+        header.boundsMax[i] = header.boundsMin[i];
+    }
+    for (const Vertex &vertex : mesh.vertices)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            header.boundsMin[i] = std::min(header.boundsMin[i], vertex.position[i]);
+            header.boundsMax[i] = std::max(header.boundsMax[i], vertex.position[i]);
+        }
+    }
+
+    // Write to a temporary name and rename so a reader never sees a partial file.
+    std::string temporary = filename + ".tmp";
+    FILE *out = fopen(temporary.c_str(), "wb");
+    if (!out)
+        return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    ok = ok && fwrite(&mesh.vertices[0], sizeof(Vertex), mesh.vertices.size(), out) == mesh.vertices.size();
+    if (header.indexType == GL_UNSIGNED_SHORT)
+    {
+        std::vector<GLushort> indices(mesh.indices.begin(), mesh.indices.end());
+        ok = ok && fwrite(&indices[0], sizeof(GLushort), indices.size(), out) == indices.size();
+    }
+    else
+        ok = ok && fwrite(&mesh.indices[0], sizeof(GLuint), mesh.indices.size(), out) == mesh.indices.size();
+    ok = fclose(out) == 0 && ok;
+#if _WIN32
+    remove(filename.c_str());
+#endif
+
+    if (!ok || rename(temporary.c_str(), filename.c_str()) != 0)
+    {
+        remove(temporary.c_str());
+        std::cerr << "Could not write mesh cache '" << filename << "'" << std::endl;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,65 @@
+
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <cstdint>
+#include <string>
+
+#include "ObjLoader.h"
+
+// Binary mesh written next to an OBJ file after its first parse, and by the
+// asset cooker. The header is followed by vertexCount vertices laid out as
+// described by vertexLayout and then indexCount indices of indexType, ready
+// to hand to glBufferData. The indices hold every level of detail back to
+// back; lods describes the first lodCount ranges.
+struct MeshCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+
+    uint32_t vertexLayout;
+    uint32_t vertexStride;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t indexType;
+    uint32_t lodCount;
+
+    uint64_t sourceSize;
+    int64_t sourceModifiedTime;
+
+    float boundsMin[3];
+    float boundsMax[3];
+
+    MeshLod lods[MAX_MESH_LODS];
+};
+
+enum { MESH_CACHE_VERSION = 4 };
+enum { VERTEX_LAYOUT_FLOAT = 1 };
+
+// A cache file mapped into memory. vertices and indices point into the
+// mapping and stay valid for as long as the CachedMesh is alive.
+struct CachedMesh
+{
+    CachedMesh() : header(0), vertices(0), indices(0) {}
+
+    MappedFile file;
+    const MeshCacheHeader *header;
+    const Vertex *vertices;
+    const void *indices;
+};
+
+std::string meshCacheFilename(const std::string &sourceFilename);
+bool readMeshCache(const std::string &sourceFilename, CachedMesh &mesh);
+bool writeMeshCache(const std::string &sourceFilename, const MeshData &mesh);
+
+// Reads a cooked mesh, rejecting it like a stale cache if its source OBJ
+// has changed since it was cooked. A pack shipped without its sources is
+// accepted as it is.
+bool readCookedMesh(const std::string &cookedFilename, const std::string &sourceFilename, CachedMesh &mesh);
+
+// Read and write a mesh file at an explicit path without checking it
+// against a source OBJ
+bool readMeshFile(const std::string &filename, CachedMesh &mesh);
+bool writeMeshFile(const std::string &filename, const MeshData &mesh, uint64_t sourceSize, int64_t sourceModifiedTime);
+
+#endif
@@ -0,0 +1,360 @@
+
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+    // Forsyth scoring parameters, see "Linear-Speed Vertex Cache Optimisation"
+    const int FORSYTH_CACHE_SIZE = 32;
+    const int FORSYTH_MAX_VALENCE = 32;
+    const float CACHE_DECAY_POWER = 1.5f;
+    const float LAST_TRIANGLE_SCORE = 0.75f;
+    const float VALENCE_BOOST_SCALE = 2.0f;
+    const float VALENCE_BOOST_POWER = 0.5f;
+
+    struct ForsythScores
+    {
+        ForsythScores()
+        {
+            for (int i = 0; i < FORSYTH_CACHE_SIZE; ++i)
+                cache[i] = i < 3 ? LAST_TRIANGLE_SCORE
+                                 : powf(1.0f - float(i - 3) / (FORSYTH_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+            for (int i = 0; i < FORSYTH_MAX_VALENCE; ++i)
+                valence[i] = i == 0 ? 0 : VALENCE_BOOST_SCALE * powf(float(i), -VALENCE_BOOST_POWER);
+        }
+
+        float cache[FORSYTH_CACHE_SIZE];
+        float valence[FORSYTH_MAX_VALENCE];
+    };
+
+    float vertexScore(const ForsythScores &scores, int cachePosition, unsigned int remaining)
+    {
+        if (remaining == 0)
+            return -1;
+
+        float score = cachePosition >= 0 ? scores.cache[cachePosition] : 0;
+        return score + scores.valence[std::min<unsigned int>(remaining, FORSYTH_MAX_VALENCE - 1)];
+    }
+
+    // FIFO post-transform cache. A vertex stays cached until size further
+    // vertices have been loaded after it.
+    struct FifoCache
+    {
+        FifoCache(size_t vertexCount, unsigned int cacheSize)
+            : timestamps(vertexCount, 0), size(cacheSize), time(cacheSize + 1) {}
+
+        unsigned int misses(const GLuint *triangle)
+        {
+            unsigned int count = 0;
+            for (int k = 0; k < 3; ++k)
+            {
+                if (time - timestamps[triangle[k]] > size)
+                {
+                    timestamps[triangle[k]] = time++;
+                    ++count;
+                }
+            }
+            return count;
+        }
+
+        void flush()
+        {
+            time += size + 1;
+        }
+
+        std::vector<unsigned int> timestamps;
+        unsigned int size;
+        unsigned int time;
+    };
+
+    struct Cluster
+    {
+        size_t begin;
+        size_t end;
+        float sortKey;
+    };
+}
+
+VertexCacheStats analyzeVertexCache(const std::vector<GLuint> &indices, size_t vertexCount, unsigned int cacheSize)
+{
+    FifoCache cache(vertexCount, cacheSize);
+
+    VertexCacheStats stats;
+    stats.misses = 0;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        stats.misses += cache.misses(&indices[i]);
+
+    size_t triangleCount = indices.size() / 3;
+    stats.acmr = triangleCount ? float(stats.misses) / triangleCount : 0;
+    stats.atvr = vertexCount ? float(stats.misses) / vertexCount : 0;
+    return stats;
+}
+
+void optimizeVertexCache(std::vector<GLuint> &indices, size_t vertexCount)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    static const ForsythScores scores;
+
+    // Live triangles per vertex, stored as one adjacency array. Emitted
+    // triangles are swapped to the end of each vertex's range.
+    std::vector<unsigned int> remaining(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+        ++remaining[indices[i]];
+
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v)
+        offsets[v + 1] = offsets[v] + remaining[v];
+
+    std::vector<unsigned int> adjacency(triangleCount * 3);
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; ++t)
+        for (int k = 0; k < 3; ++k)
+            adjacency[fill[indices[t * 3 + k]]++] = (unsigned int) t;
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+        vertexScores[v] = vertexScore(scores, -1, remaining[v]);
+
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    size_t best = 0;
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        const GLuint *triangle = &indices[t * 3];
+        triangleScores[t] = vertexScores[triangle[0]] + vertexScores[triangle[1]] + vertexScores[triangle[2]];
+        if (triangleScores[t] > triangleScores[best])
+            best = t;
+    }
+
+    std::vector<GLuint> result;
+    result.reserve(triangleCount * 3);
+
+    GLuint cache[FORSYTH_CACHE_SIZE + 3];
+    GLuint nextCache[FORSYTH_CACHE_SIZE + 3];
+    size_t cacheCount = 0;
+    size_t cursor = 0;
+
+    while (true)
+    {
+        const GLuint *triangle = &indices[best * 3];
+        emitted[best] = true;
+        result.insert(result.end(), triangle, triangle + 3);
+
+        for (int k = 0; k < 3; ++k)
+        {
+            unsigned int *live = &adjacency[offsets[triangle[k]]];
+            unsigned int count = remaining[triangle[k]];
+            for (unsigned int i = 0; i < count; ++i)
+            {
+                if (live[i] == best)
+                {
+                    std::swap(live[i], live[count - 1]);
+                    break;
+                }
+            }
+            --remaining[triangle[k]];
+        }
+
+        // The emitted triangle moves to the front of the LRU cache
+        size_t nextCount = 0;
+        for (int k = 0; k < 3; ++k)
+            if (std::find(nextCache, nextCache + nextCount, triangle[k]) == nextCache + nextCount)
+                nextCache[nextCount++] = triangle[k];
+        for (size_t i = 0; i < cacheCount; ++i)
+            if (cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2])
+                nextCache[nextCount++] = cache[i];
+
+        for (size_t i = 0; i < nextCount; ++i)
+        {
+            GLuint v = nextCache[i];
+            cachePosition[v] = i < FORSYTH_CACHE_SIZE ? (int) i : -1;
+            vertexScores[v] = vertexScore(scores, cachePosition[v], remaining[v]);
+        }
+
+        cacheCount = std::min<size_t>(nextCount, FORSYTH_CACHE_SIZE);
+        std::copy(nextCache, nextCache + cacheCount, cache);
+
+        // Only triangles touching changed vertices can change score, so the
+        // next triangle is picked among those
+        float bestScore = -1;
+        for (size_t i = 0; i < nextCount; ++i)
+        {
+            GLuint v = nextCache[i];
+            const unsigned int *live = &adjacency[offsets[v]];
+            for (unsigned int j = 0; j < remaining[v]; ++j)
+            {
+                unsigned int t = live[j];
+                const GLuint *other = &indices[t * 3];
+                triangleScores[t] = vertexScores[other[0]] + vertexScores[other[1]] + vertexScores[other[2]];
+                if (triangleScores[t] > bestScore)
+                {
+                    bestScore = triangleScores[t];
+                    best = t;
+                }
+            }
+        }
+
+        if (bestScore < 0)
+        {
+            while (cursor < triangleCount && emitted[cursor])
+                ++cursor;
+            if (cursor == triangleCount)
+                break;
+            best = cursor;
+        }
+    }
+
+    result.insert(result.end(), indices.begin() + triangleCount * 3, indices.end());
+    indices.swap(result);
+}
+
+void optimizeOverdraw(std::vector<GLuint> &indices, const std::vector<Vertex> &vertices, float threshold)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    FifoCache cache(vertices.size(), VERTEX_CACHE_SIZE);
+
+    // A triangle that misses on all three vertices usually starts a new,
+    // disjoint patch of the mesh
+    std::vector<size_t> patches;
+    for (size_t t = 0; t < triangleCount; ++t)
+        if (cache.misses(&indices[t * 3]) == 3 || t == 0)
+            patches.push_back(t);
+    patches.push_back(triangleCount);
+
+    // Patches are split further wherever the running ACMR, counted from a
+    // cold cache, drops to threshold times the ACMR of the whole patch
+    std::vector<Cluster> clusters;
+    for (size_t p = 0; p + 1 < patches.size(); ++p)
+    {
+        size_t begin = patches[p];
+        size_t end = patches[p + 1];
+
+        cache.flush();
+        unsigned int patchMisses = 0;
+        for (size_t t = begin; t < end; ++t)
+            patchMisses += cache.misses(&indices[t * 3]);
+        float target = threshold * patchMisses / (end - begin);
+
+        size_t first = clusters.size();
+        Cluster cluster = { begin, begin, 0 };
+        unsigned int misses = 0;
+        cache.flush();
+        for (size_t t = begin; t < end; ++t)
+        {
+            misses += cache.misses(&indices[t * 3]);
+            cluster.end = t + 1;
+            if (float(misses) / (cluster.end - cluster.begin) <= target)
+            {
+                clusters.push_back(cluster);
+                cluster.begin = cluster.end;
+                misses = 0;
+                cache.flush();
+            }
+        }
+
+        // The tail rarely reaches the target, so it joins the last cluster
+        if (cluster.begin != end)
+        {
+            if (clusters.size() > first)
+                clusters.back().end = end;
+            else
+                clusters.push_back(cluster);
+        }
+    }
+
+    gl::Vector3 meshCentroid(0, 0, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+        meshCentroid = meshCentroid + vertices[indices[i]].position;
+    meshCentroid /= float(triangleCount * 3);
+
+    // Clusters that face away from the mesh centre are drawn first so they
+    // occlude the inner and back-facing ones
+    for (Cluster &cluster : clusters)
+    {
+        gl::Vector3 centroid(0, 0, 0);
+        gl::Vector3 normal(0, 0, 0);
+        float area = 0;
+        for (size_t t = cluster.begin; t < cluster.end; ++t)
+        {
+            const gl::Vector3 &p0 = vertices[indices[t * 3 + 0]].position;
+            const gl::Vector3 &p1 = vertices[indices[t * 3 + 1]].position;
+            const gl::Vector3 &p2 = vertices[indices[t * 3 + 2]].position;
+
+            gl::Vector3 faceNormal = gl::cross(p1 - p0, p2 - p0);
+            float faceArea = faceNormal.length();
+            centroid = centroid + (p0 + p1 + p2) * (faceArea / 3);
+            normal = normal + faceNormal;
+            area += faceArea;
+        }
+
+        float normalLength = normal.length();
+        if (area > 0)
+            centroid /= area;
+        if (normalLength > 0)
+            normal /= normalLength;
+        cluster.sortKey = area > 0 ? gl::dot(centroid - meshCentroid, normal) : 0;
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b)
+    {
+        return a.sortKey > b.sortKey;
+    });
+
+    std::vector<GLuint> result;
+    result.reserve(indices.size());
+    for (const Cluster &cluster : clusters)
+        result.insert(result.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+    result.insert(result.end(), indices.begin() + triangleCount * 3, indices.end());
+    indices.swap(result);
+}
+
+void optimizeVertexFetch(MeshData &mesh)
+{
+    const GLuint UNUSED = ~0u;
+    std::vector<GLuint> remap(mesh.vertices.size(), UNUSED);
+    std::vector<Vertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+
+    for (GLuint &index : mesh.indices)
+    {
+        if (remap[index] == UNUSED)
+        {
+            remap[index] = (GLuint) vertices.size();
+            vertices.push_back(mesh.vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    mesh.vertices.swap(vertices);
+}
+
+void optimizeMesh(MeshData &mesh, const std::string &name)
+{
+    auto start = std::chrono::steady_clock::now();
+    VertexCacheStats before = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+
+    optimizeVertexCache(mesh.indices, mesh.vertices.size());
+    optimizeOverdraw(mesh.indices, mesh.vertices);
+    optimizeVertexFetch(mesh);
+
+    VertexCacheStats after = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::ostringstream message;
+    message << "Optimized Model '" << name << "' ACMR: " << before.acmr << " -> " << after.acmr
+            << " ATVR: " << before.atvr << " -> " << after.atvr
+            << " time: " << seconds * 1000 << " ms" << std::endl;
+    std::cout << message.str();
+}
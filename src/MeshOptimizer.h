@@ -0,0 +1,42 @@
+
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <string>
+#include <vector>
+
+#include "ObjLoader.h"
+
+// Post-transform vertex cache statistics for an indexed triangle list,
+// measured with a FIFO cache of cacheSize entries. ACMR is vertex shader
+// invocations per triangle (0.5 is ideal for large regular meshes, 3 is the
+// worst case); ATVR is invocations per unique vertex (1 is ideal).
+struct VertexCacheStats
+{
+    size_t misses;
+    float acmr;
+    float atvr;
+};
+
+enum { VERTEX_CACHE_SIZE = 16 };
+
+VertexCacheStats analyzeVertexCache(const std::vector<GLuint> &indices, size_t vertexCount,
+                                    unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+// Reorders triangles for the post-transform vertex cache using Forsyth's
+// linear-speed vertex cache optimisation.
+void optimizeVertexCache(std::vector<GLuint> &indices, size_t vertexCount);
+
+// Splits a cache-optimised triangle order into clusters that cost at most
+// threshold times the current ACMR and sorts the clusters so that outward
+// facing ones draw first, reducing overdraw while keeping most of the cache
+// hits.
+void optimizeOverdraw(std::vector<GLuint> &indices, const std::vector<Vertex> &vertices, float threshold = 1.05f);
+
+// Renumbers vertices in the order the index buffer first references them.
+void optimizeVertexFetch(MeshData &mesh);
+
+// Runs all three passes and logs the ACMR/ATVR before and after.
+void optimizeMesh(MeshData &mesh, const std::string &name);
+
+#endif
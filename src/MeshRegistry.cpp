@@ -0,0 +1,318 @@
+
+#include "MeshRegistry.h"
+#include "ObjLoader.h"
+#include "VertexPacking.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+    const GLuint NO_POOL = ~0u;
+
+    const size_t INITIAL_VERTEX_BYTES = 1 << 20;
+    const size_t INITIAL_INDEX_BYTES = 256 << 10;
+    const size_t MAX_POOL_BYTES = 64 << 20;
+
+    size_t vertexSize()
+    {
+        return packedVertices ? sizeof(PackedVertex) : sizeof(Vertex);
+    }
+
+    // Index ranges start on a 4-byte boundary so that 16 and 32-bit meshes
+    // can share an index buffer
+    size_t alignIndexBytes(size_t bytes)
+    {
+        return (bytes + 3) & ~(size_t) 3;
+    }
+
+    // Replaces buffer with a larger one holding the same first usedBytes
+    GLuint resizeBuffer(GLuint buffer, size_t usedBytes, size_t capacity)
+    {
+        GLuint resized;
+        glGenBuffers(1, &resized);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, resized);
+        glBufferData(GL_COPY_WRITE_BUFFER, capacity, NULL, GL_STATIC_DRAW);
+        if (buffer)
+        {
+            if (usedBytes)
+            {
+                glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+                glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            }
+            glDeleteBuffers(1, &buffer);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return resized;
+    }
+
+    // Points the attributes of the bound vertex array at the bound buffer
+    void setVertexAttributes()
+    {
+        if (packedVertices)
+        {
+            glVertexAttribPointer(0, 3, GL_SHORT, GL_FALSE, sizeof(PackedVertex), OFFSET(PackedVertex, position));
+            glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), OFFSET(PackedVertex, textureCoord));
+            glVertexAttribPointer(2, 2, GL_SHORT, GL_FALSE, sizeof(PackedVertex), OFFSET(PackedVertex, normal));
+        }
+        else
+        {
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), OFFSET(Vertex, position));
+            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), OFFSET(Vertex, textureCoord));
+            glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), OFFSET(Vertex, normal));
+        }
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+    }
+
+    // Points the instance attributes of the bound vertex array at the
+    // instance bound to GL_ARRAY_BUFFER, first instances in. Returns the
+    // number of GL calls made.
+    unsigned int setInstanceAttributes(GLuint first)
+    {
+        size_t offset = first * sizeof(InstanceData);
+        for (GLuint column = 0; column < 4; ++column)
+            glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (GLvoid *) (offset + offsetof(InstanceData, modelview) + column * 4 * sizeof(float)));
+        glVertexAttribPointer(7, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (GLvoid *) (offset + offsetof(InstanceData, diffuseColor)));
+        glVertexAttribPointer(8, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (GLvoid *) (offset + offsetof(InstanceData, specularColor)));
+        glVertexAttribPointer(9, 1, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (GLvoid *) (offset + offsetof(InstanceData, shininess)));
+        glVertexAttribIPointer(10, 1, GL_UNSIGNED_INT, sizeof(InstanceData), (GLvoid *) (offset + offsetof(InstanceData, objectID)));
+        return 4 + 4;
+    }
+}
+
+MeshEntry::MeshEntry()
+    : pool(NO_POOL), baseVertex(0), vertexCount(0), indexOffset(0), indexType(GL_NONE), lodCount(0),
+      positionScale(1, 1, 1), positionOffset(0, 0, 0)
+{
+}
+
+MeshRegistry::MeshRegistry()
+    : m_boundPool(NO_POOL), m_instanceBuffer(0), m_instanceCapacity(0)
+{
+}
+
+MeshHandle MeshRegistry::add(const std::string &filename)
+{
+    std::map<std::string, MeshHandle>::const_iterator found = m_handles.find(filename);
+    if (found != m_handles.end())
+        return found->second;
+
+    MeshHandle mesh = (MeshHandle) m_meshes.size();
+    m_meshes.push_back(MeshEntry());
+    m_meshes.back().filename = filename;
+    m_handles[filename] = mesh;
+    return mesh;
+}
+
+MeshHandle MeshRegistry::find(const std::string &filename) const
+{
+    std::map<std::string, MeshHandle>::const_iterator found = m_handles.find(filename);
+    return found != m_handles.end() ? found->second : INVALID_MESH;
+}
+
+void MeshRegistry::upload(MeshHandle mesh, const void *vertices, size_t vertexCount, const void *indices, size_t indexCount, GLenum indexType)
+{
+    size_t indexBytes = indexSize(indexType) * indexCount;
+
+    MeshEntry &entry = m_meshes[mesh];
+    entry.pool = allocate(vertexCount, indexBytes);
+    Pool &pool = m_pools[entry.pool];
+    entry.baseVertex = (GLint) pool.vertexCount;
+    entry.vertexCount = (GLuint) vertexCount;
+    entry.indexOffset = pool.indexBytes;
+    entry.indexType = indexType;
+
+    // The element array binding belongs to the vertex array, so the index
+    // buffer is written through the copy target instead
+    glBindBuffer(GL_ARRAY_BUFFER, pool.vertexBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, vertexSize() * pool.vertexCount, vertexSize() * vertexCount, vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, pool.indexBuffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, pool.indexBytes, indexBytes, indices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    pool.vertexCount += vertexCount;
+    pool.indexBytes += alignIndexBytes(indexBytes);
+}
+
+size_t MeshRegistry::reserveVertices(MeshHandle mesh, size_t vertexCount)
+{
+    MeshEntry &entry = m_meshes[mesh];
+    entry.pool = allocate(vertexCount, 0);
+    Pool &pool = m_pools[entry.pool];
+    entry.baseVertex = (GLint) pool.vertexCount;
+    entry.vertexCount = (GLuint) vertexCount;
+    entry.indexOffset = 0;
+    entry.indexType = GL_NONE;
+
+    pool.vertexCount += vertexCount;
+    glBindBuffer(GL_ARRAY_BUFFER, pool.vertexBuffer);
+    return vertexSize() * entry.baseVertex;
+}
+
+void MeshRegistry::trimVertices(MeshHandle mesh, size_t vertexCount)
+{
+    MeshEntry &entry = m_meshes[mesh];
+    Pool &pool = m_pools[entry.pool];
+    if (pool.vertexCount == entry.baseVertex + entry.vertexCount)
+        pool.vertexCount = entry.baseVertex + vertexCount;
+    entry.vertexCount = (GLuint) vertexCount;
+}
+
+bool MeshRegistry::bind(MeshHandle mesh)
+{
+    GLuint pool = m_meshes[mesh].pool;
+    if (pool == m_boundPool || pool == NO_POOL)
+        return false;
+
+    glBindVertexArray(m_pools[pool].vertexArray);
+    m_boundPool = pool;
+    return true;
+}
+
+void MeshRegistry::unbind()
+{
+    glBindVertexArray(0);
+    m_boundPool = NO_POOL;
+}
+
+unsigned int MeshRegistry::uploadInstances(const InstanceData *instances, size_t count)
+{
+    // Orphans the old contents so that draws still reading them don't stall
+    size_t bytes = count * sizeof(InstanceData);
+    m_instanceCapacity = std::max(bytes, m_instanceCapacity);
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, m_instanceCapacity, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, instances);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return 4;
+}
+
+unsigned int MeshRegistry::bindInstances(GLuint first)
+{
+    if (m_boundPool == NO_POOL || m_pools[m_boundPool].firstInstance == first)
+        return 0;
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+    unsigned int calls = setInstanceAttributes(first);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_pools[m_boundPool].firstInstance = first;
+    return calls + 2;
+}
+
+void MeshRegistry::drawInstanced(MeshHandle mesh, const MeshLod &range, GLsizei count) const
+{
+    const MeshEntry &entry = m_meshes[mesh];
+    if (entry.pool == NO_POOL)
+        return;
+
+    if (entry.indexType == GL_NONE)
+        glDrawArraysInstanced(GL_TRIANGLES, entry.baseVertex + range.indexOffset, range.indexCount, count);
+    else
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.indexCount, entry.indexType,
+                                          (const void *) (entry.indexOffset + range.indexOffset * indexSize(entry.indexType)),
+                                          count, entry.baseVertex);
+}
+
+bool MeshRegistry::raycast(MeshHandle mesh, const Ray &ray, TriangleHit &hit, GLenum cull) const
+{
+    return m_meshes[mesh].triangles.raycast(ray, hit, cull);
+}
+
+void MeshRegistry::logUsage() const
+{
+    size_t vertexBytes = 0;
+    size_t vertexCapacity = 0;
+    size_t indexBytes = 0;
+    size_t indexCapacity = 0;
+    for (const Pool &pool : m_pools)
+    {
+        vertexBytes += vertexSize() * pool.vertexCount;
+        vertexCapacity += vertexSize() * pool.vertexCapacity;
+        indexBytes += pool.indexBytes;
+        indexCapacity += pool.indexCapacity;
+    }
+
+    std::ostringstream message;
+    message << "Mesh Registry meshes: " << m_meshes.size() << " pools: " << m_pools.size()
+            << " vertex bytes: " << vertexBytes << " / " << vertexCapacity
+            << " index bytes: " << indexBytes << " / " << indexCapacity << std::endl;
+    std::cout << message.str();
+}
+
+GLuint MeshRegistry::allocate(size_t vertexCount, size_t indexBytes)
+{
+    // A mesh too big for any pool still gets one to itself
+    bool full = false;
+    if (!m_pools.empty())
+    {
+        const Pool &last = m_pools.back();
+        bool empty = last.vertexCount == 0 && last.indexBytes == 0;
+        full = !empty && (vertexSize() * (last.vertexCount + vertexCount) > MAX_POOL_BYTES ||
+                          last.indexBytes + indexBytes > MAX_POOL_BYTES);
+    }
+
+    if (m_pools.empty() || full)
+    {
+        Pool pool = { 0, 0, 0, 0, 0, 0, 0, 0 };
+        glGenVertexArrays(1, &pool.vertexArray);
+
+        if (!m_instanceBuffer)
+            glGenBuffers(1, &m_instanceBuffer);
+        glBindVertexArray(pool.vertexArray);
+        glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+        setInstanceAttributes(0);
+        for (GLuint attribute = 3; attribute <= 10; ++attribute)
+        {
+            glEnableVertexAttribArray(attribute);
+            glVertexAttribDivisor(attribute, 1);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+        m_boundPool = NO_POOL;
+
+        m_pools.push_back(pool);
+    }
+
+    Pool &pool = m_pools.back();
+    reserve(pool, pool.vertexCount + vertexCount, pool.indexBytes + indexBytes);
+    return (GLuint) m_pools.size() - 1;
+}
+
+void MeshRegistry::reserve(Pool &pool, size_t vertexCount, size_t indexBytes)
+{
+    bool growVertices = vertexCount > pool.vertexCapacity;
+    bool growIndices = indexBytes > pool.indexCapacity || !pool.indexBuffer;
+    if (!growVertices && !growIndices)
+        return;
+
+    glBindVertexArray(pool.vertexArray);
+    m_boundPool = NO_POOL;
+
+    if (growVertices)
+    {
+        size_t capacity = std::max(std::max(vertexCount, pool.vertexCapacity * 2), INITIAL_VERTEX_BYTES / vertexSize());
+        pool.vertexBuffer = resizeBuffer(pool.vertexBuffer, vertexSize() * pool.vertexCount, vertexSize() * capacity);
+        pool.vertexCapacity = capacity;
+
+        glBindBuffer(GL_ARRAY_BUFFER, pool.vertexBuffer);
+        setVertexAttributes();
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    if (growIndices)
+    {
+        size_t capacity = std::max(std::max(indexBytes, pool.indexCapacity * 2), INITIAL_INDEX_BYTES);
+        pool.indexBuffer = resizeBuffer(pool.indexBuffer, pool.indexBytes, capacity);
+        pool.indexCapacity = capacity;
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.indexBuffer);
+    }
+
+    glBindVertexArray(0);
+}
@@ -0,0 +1,134 @@
+
+#ifndef MESH_REGISTRY_H
+#define MESH_REGISTRY_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Bounds.h"
+#include "TriangleBvh.h"
+#include "Util.h"
+
+// Where a mesh lives in the shared buffers and what drawing it needs.
+// Index ranges in lods are relative to the mesh's first index, and indices
+// are relative to baseVertex.
+struct MeshEntry
+{
+    MeshEntry();
+
+    std::string filename;
+
+    GLuint pool;
+    GLint baseVertex;
+    GLuint vertexCount;
+    size_t indexOffset;     // In bytes
+    GLenum indexType;       // GL_NONE draws the vertices without indices
+
+    MeshLod lods[MAX_MESH_LODS];
+    GLuint lodCount;
+
+    Bounds bounds;
+    gl::Vector3 positionScale;
+    gl::Vector3 positionOffset;
+
+    // Full-precision level 0 triangles for CPU ray casts
+    TriangleBvh triangles;
+};
+
+const MeshHandle INVALID_MESH = ~0u;
+
+// Per-instance vertex attributes. Every pool's vertex array reads them from
+// the instance buffer at locations 3 to 6 for the modelview columns, then 7
+// to 10 in member order.
+struct InstanceData
+{
+    float modelview[16];
+    float diffuseColor[3];
+    float specularColor[3];
+    float shininess;
+    GLuint objectID;
+};
+
+// Meshes loaded at runtime by path. All meshes are suballocated from a few
+// pools, each a vertex array with one shared vertex buffer and one shared
+// index buffer, so consecutive draws rarely rebind anything. Pools grow by
+// copying into a larger buffer until they reach MAX_POOL_BYTES; after that
+// a new pool is started.
+class MeshRegistry
+{
+public:
+    MeshRegistry();
+
+    // Returns the handle for filename, adding an empty entry the first time.
+    MeshHandle add(const std::string &filename);
+    MeshHandle find(const std::string &filename) const;
+
+    size_t size() const { return m_meshes.size(); }
+    MeshEntry &operator[](MeshHandle mesh) { return m_meshes[mesh]; }
+    const MeshEntry &operator[](MeshHandle mesh) const { return m_meshes[mesh]; }
+
+    // Copies a mesh into the shared buffers. vertices are in the current
+    // vertex format, Vertex or PackedVertex depending on packedVertices.
+    void upload(MeshHandle mesh, const void *vertices, size_t vertexCount, const void *indices, size_t indexCount, GLenum indexType);
+
+    // Reserves vertexCount vertices for a mesh drawn without indices and
+    // leaves the pool's vertex buffer bound to GL_ARRAY_BUFFER for the caller
+    // to fill. Returns the byte offset of the reserved range.
+    size_t reserveVertices(MeshHandle mesh, size_t vertexCount);
+
+    // Shrinks the last reservation to the vertexCount vertices actually used
+    void trimVertices(MeshHandle mesh, size_t vertexCount);
+
+    // Binds the vertex array of the mesh's pool unless it is already bound.
+    // Returns true if it had to be bound.
+    bool bind(MeshHandle mesh);
+
+    // Must be called before anything else binds a vertex array
+    void unbind();
+
+    // Replaces the contents of the instance buffer. Returns the number of GL
+    // calls made.
+    unsigned int uploadInstances(const InstanceData *instances, size_t count);
+
+    // Points the instance attributes of the bound pool at instance first
+    // unless they already are. Returns the number of GL calls made, 0 if
+    // nothing had to change.
+    unsigned int bindInstances(GLuint first);
+
+    // Draws count instances of one index range of a mesh whose pool is
+    // bound, starting at the instance given to bindInstances
+    void drawInstanced(MeshHandle mesh, const MeshLod &range, GLsizei count) const;
+
+    // Nearest level 0 triangle of a mesh hit by a ray in object space
+    bool raycast(MeshHandle mesh, const Ray &ray, TriangleHit &hit, GLenum cull = GL_NONE) const;
+
+    void logUsage() const;
+
+private:
+    struct Pool
+    {
+        GLuint vertexArray;
+        GLuint vertexBuffer;
+        GLuint indexBuffer;
+        size_t vertexCapacity;  // In vertices
+        size_t vertexCount;
+        size_t indexCapacity;   // In bytes
+        size_t indexBytes;
+        GLuint firstInstance;   // Where the instance attributes point
+    };
+
+    GLuint allocate(size_t vertexCount, size_t indexBytes);
+    void reserve(Pool &pool, size_t vertexCount, size_t indexBytes);
+
+    std::vector<MeshEntry> m_meshes;
+    std::map<std::string, MeshHandle> m_handles;
+    std::vector<Pool> m_pools;
+    GLuint m_boundPool;
+    GLuint m_instanceBuffer;
+    size_t m_instanceCapacity;  // In bytes
+};
+
+extern MeshRegistry meshes;
+
+#endif
@@ -0,0 +1,421 @@
+
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+namespace
+{
+    // Symmetric 4x4 matrix summing squared distances to a set of planes,
+    // together with the total plane weight so errors are averages
+    struct Quadric
+    {
+        double a00, a01, a02, a03;
+        double a11, a12, a13;
+        double a22, a23;
+        double a33;
+        double weight;
+    };
+
+    void addPlane(Quadric &q, const gl::Vector3 &normal, double distance, double weight)
+    {
+        double a = normal[0], b = normal[1], c = normal[2], d = distance;
+        q.a00 += weight * a * a; q.a01 += weight * a * b; q.a02 += weight * a * c; q.a03 += weight * a * d;
+        q.a11 += weight * b * b; q.a12 += weight * b * c; q.a13 += weight * b * d;
+        q.a22 += weight * c * c; q.a23 += weight * c * d;
+        q.a33 += weight * d * d;
+        q.weight += weight;
+    }
+
+    void addQuadric(Quadric &q, const Quadric &other)
+    {
+        q.a00 += other.a00; q.a01 += other.a01; q.a02 += other.a02; q.a03 += other.a03;
+        q.a11 += other.a11; q.a12 += other.a12; q.a13 += other.a13;
+        q.a22 += other.a22; q.a23 += other.a23;
+        q.a33 += other.a33;
+        q.weight += other.weight;
+    }
+
+    // Mean squared distance from p to the planes of q
+    double evaluate(const Quadric &q, const gl::Vector3 &p)
+    {
+        double x = p[0], y = p[1], z = p[2];
+        double error = q.a00 * x * x + 2 * q.a01 * x * y + 2 * q.a02 * x * z + 2 * q.a03 * x +
+                       q.a11 * y * y + 2 * q.a12 * y * z + 2 * q.a13 * y +
+                       q.a22 * z * z + 2 * q.a23 * z +
+                       q.a33;
+        return q.weight > 0 ? std::max(0.0, error / q.weight) : 0;
+    }
+
+    struct Collapse
+    {
+        GLuint from;
+        GLuint to;
+        double error;
+    };
+
+    uint64_t edgeKey(GLuint a, GLuint b)
+    {
+        return ((uint64_t) a << 32) | b;
+    }
+
+    // Maps every vertex to the first vertex with the same position. Vertices
+    // that differ only in texture coordinate or normal (wedges) move together.
+    std::vector<GLuint> weldPositions(const std::vector<Vertex> &vertices)
+    {
+        std::vector<GLuint> order(vertices.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            order[i] = (GLuint) i;
+        auto less = [&](GLuint a, GLuint b)
+        {
+            const gl::Vector3 &p = vertices[a].position;
+            const gl::Vector3 &q = vertices[b].position;
+            return p[0] != q[0] ? p[0] < q[0] : p[1] != q[1] ? p[1] < q[1] : p[2] < q[2];
+        };
+        std::sort(order.begin(), order.end(), less);
+
+        std::vector<GLuint> weld(vertices.size());
+        for (size_t i = 0; i < order.size(); )
+        {
+            size_t j = i + 1;
+            while (j < order.size() && !less(order[i], order[j]))
+                ++j;
+            GLuint first = *std::min_element(order.begin() + i, order.begin() + j);
+            for (size_t k = i; k < j; ++k)
+                weld[order[k]] = first;
+            i = j;
+        }
+        return weld;
+    }
+
+    // Marks welded vertices on an open or non-manifold edge
+    std::vector<bool> findBorderVertices(const std::vector<GLuint> &weld, const std::vector<GLuint> &indices)
+    {
+        std::unordered_map<uint64_t, unsigned int> edges;
+        edges.reserve(indices.size());
+        for (size_t i = 0; i < indices.size(); i += 3)
+            for (int k = 0; k < 3; ++k)
+                ++edges[edgeKey(weld[indices[i + k]], weld[indices[i + (k + 1) % 3]])];
+
+        std::vector<bool> border(weld.size(), false);
+        for (auto &edge : edges)
+        {
+            GLuint a = (GLuint) (edge.first >> 32);
+            GLuint b = (GLuint) edge.first;
+            auto opposite = edges.find(edgeKey(b, a));
+            if (edge.second != 1 || opposite == edges.end() || opposite->second != 1)
+            {
+                border[a] = true;
+                border[b] = true;
+            }
+        }
+        return border;
+    }
+
+    bool containsGroup(const std::vector<GLuint> &weld, const GLuint *triangle, GLuint group)
+    {
+        return weld[triangle[0]] == group || weld[triangle[1]] == group || weld[triangle[2]] == group;
+    }
+
+    // True when moving from onto to would flip any triangle around from that
+    // survives the collapse
+    bool flipsTriangle(const std::vector<Vertex> &vertices, const std::vector<GLuint> &weld, const std::vector<GLuint> &indices,
+                       const unsigned int *triangles, unsigned int triangleCount, GLuint from, GLuint to)
+    {
+        for (unsigned int i = 0; i < triangleCount; ++i)
+        {
+            const GLuint *triangle = &indices[triangles[i] * 3];
+            if (containsGroup(weld, triangle, to))
+                continue;
+
+            gl::Vector3 before[3], after[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                before[k] = vertices[triangle[k]].position;
+                after[k] = weld[triangle[k]] == from ? vertices[to].position : before[k];
+            }
+
+            gl::Vector3 oldNormal = gl::cross(before[1] - before[0], before[2] - before[0]);
+            gl::Vector3 newNormal = gl::cross(after[1] - after[0], after[2] - after[0]);
+            if (gl::dot(oldNormal, newNormal) <= 0)
+                return true;
+        }
+        return false;
+    }
+
+    // Picks the wedge of to that each surviving wedge of from turns into.
+    // Wedges joined to to by a triangle edge follow that edge; others may
+    // only move onto a wedge with the same texture coordinate, so texture
+    // seams stay where they are. Returns false if a wedge has no target.
+    bool mapWedges(const std::vector<Vertex> &vertices, const std::vector<GLuint> &weld, const std::vector<GLuint> &indices,
+                   const unsigned int *triangles, unsigned int triangleCount, GLuint from, GLuint to,
+                   const std::vector<GLuint> &wedges, std::vector<GLuint> &remap)
+    {
+        for (unsigned int i = 0; i < triangleCount; ++i)
+        {
+            const GLuint *triangle = &indices[triangles[i] * 3];
+            for (int k = 0; k < 3; ++k)
+            {
+                GLuint a = triangle[k];
+                GLuint b = triangle[(k + 1) % 3];
+                if (weld[a] == from && weld[b] == to && remap[a] == a)
+                    remap[a] = b;
+                else if (weld[b] == from && weld[a] == to && remap[b] == b)
+                    remap[b] = a;
+            }
+        }
+
+        for (unsigned int i = 0; i < triangleCount; ++i)
+        {
+            const GLuint *triangle = &indices[triangles[i] * 3];
+            if (containsGroup(weld, triangle, to))
+                continue;
+
+            for (int k = 0; k < 3; ++k)
+            {
+                GLuint wedge = triangle[k];
+                if (weld[wedge] != from || remap[wedge] != wedge)
+                    continue;
+
+                const gl::Vector2 &uv = vertices[wedge].textureCoord;
+                for (GLuint candidate = to; ; candidate = wedges[candidate])
+                {
+                    const gl::Vector2 &other = vertices[candidate].textureCoord;
+                    if (std::fabs(uv[0] - other[0]) < 1e-5f && std::fabs(uv[1] - other[1]) < 1e-5f)
+                    {
+                        remap[wedge] = candidate;
+                        break;
+                    }
+                    if (wedges[candidate] == to)
+                        break;
+                }
+
+                if (remap[wedge] == wedge)
+                    return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+std::vector<GLuint> simplifyMesh(const std::vector<Vertex> &vertices, const std::vector<GLuint> &indices,
+                                 size_t targetIndexCount, float maxError, float *resultError)
+{
+    std::vector<GLuint> result(indices.begin(), indices.begin() + indices.size() / 3 * 3);
+    std::vector<GLuint> weld = weldPositions(vertices);
+    std::vector<bool> locked = findBorderVertices(weld, result);
+
+    // Circular list through the wedges of each welded vertex
+    std::vector<GLuint> wedges(vertices.size());
+    for (size_t v = 0; v < vertices.size(); ++v)
+        wedges[v] = (GLuint) v;
+    for (size_t v = 0; v < vertices.size(); ++v)
+    {
+        if (weld[v] != v)
+        {
+            wedges[v] = wedges[weld[v]];
+            wedges[weld[v]] = (GLuint) v;
+        }
+    }
+
+    std::vector<Quadric> quadrics(vertices.size(), Quadric());
+    for (size_t i = 0; i < result.size(); i += 3)
+    {
+        const gl::Vector3 &p0 = vertices[result[i + 0]].position;
+        const gl::Vector3 &p1 = vertices[result[i + 1]].position;
+        const gl::Vector3 &p2 = vertices[result[i + 2]].position;
+
+        gl::Vector3 normal = gl::cross(p1 - p0, p2 - p0);
+        float area = normal.length();
+        if (area == 0)
+            continue;
+        normal /= area;
+
+        Quadric plane = Quadric();
+        addPlane(plane, normal, -gl::dot(normal, p0), area);
+        for (int k = 0; k < 3; ++k)
+            addQuadric(quadrics[weld[result[i + k]]], plane);
+    }
+
+    double maxErrorSquared = (double) maxError * maxError;
+    double worstError = 0;
+
+    std::vector<unsigned int> offsets(vertices.size() + 1);
+    std::vector<unsigned int> adjacency;
+    std::vector<Collapse> collapses;
+    std::vector<GLuint> remap(vertices.size());
+    std::vector<bool> touched(vertices.size());
+
+    // Each pass collapses a batch of the cheapest independent edges between
+    // welded vertices and then rebuilds the index buffer
+    while (result.size() > targetIndexCount)
+    {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (GLuint index : result)
+            ++offsets[weld[index] + 1];
+        for (size_t v = 0; v < vertices.size(); ++v)
+            offsets[v + 1] += offsets[v];
+
+        adjacency.resize(result.size());
+        std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < result.size(); ++i)
+            adjacency[fill[weld[result[i]]]++] = (unsigned int) (i / 3);
+
+        collapses.clear();
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                // Interior edges appear once in each direction; take one
+                GLuint a = weld[result[i + k]];
+                GLuint b = weld[result[i + (k + 1) % 3]];
+                if (a > b)
+                    continue;
+
+                Quadric q = quadrics[a];
+                addQuadric(q, quadrics[b]);
+                if (!locked[a])
+                    collapses.push_back({ a, b, evaluate(q, vertices[b].position) });
+                if (!locked[b])
+                    collapses.push_back({ b, a, evaluate(q, vertices[a].position) });
+            }
+        }
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b)
+        {
+            return a.error < b.error;
+        });
+
+        for (size_t v = 0; v < vertices.size(); ++v)
+            remap[v] = (GLuint) v;
+        std::fill(touched.begin(), touched.end(), false);
+
+        size_t removeTarget = (result.size() - targetIndexCount) / 3;
+        size_t removed = 0;
+        size_t applied = 0;
+        for (const Collapse &collapse : collapses)
+        {
+            if (collapse.error > maxErrorSquared || removed >= removeTarget)
+                break;
+            if (touched[collapse.from] || touched[collapse.to])
+                continue;
+
+            const unsigned int *triangles = &adjacency[offsets[collapse.from]];
+            unsigned int triangleCount = offsets[collapse.from + 1] - offsets[collapse.from];
+            if (flipsTriangle(vertices, weld, result, triangles, triangleCount, collapse.from, collapse.to))
+                continue;
+
+            if (!mapWedges(vertices, weld, result, triangles, triangleCount, collapse.from, collapse.to, wedges, remap))
+            {
+                for (GLuint wedge = collapse.from; ; )
+                {
+                    remap[wedge] = wedge;
+                    wedge = wedges[wedge];
+                    if (wedge == collapse.from)
+                        break;
+                }
+                continue;
+            }
+
+            // Freeze the one-ring so no neighbouring collapse invalidates the
+            // tests above
+            for (unsigned int i = 0; i < triangleCount; ++i)
+            {
+                const GLuint *triangle = &result[triangles[i] * 3];
+                for (int k = 0; k < 3; ++k)
+                    touched[weld[triangle[k]]] = true;
+                if (containsGroup(weld, triangle, collapse.to))
+                    ++removed;
+            }
+
+            addQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+            worstError = std::max(worstError, collapse.error);
+            ++applied;
+        }
+
+        if (applied == 0)
+            break;
+
+        size_t count = 0;
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            GLuint a = remap[result[i + 0]];
+            GLuint b = remap[result[i + 1]];
+            GLuint c = remap[result[i + 2]];
+            if (weld[a] != weld[b] && weld[b] != weld[c] && weld[a] != weld[c])
+            {
+                result[count++] = a;
+                result[count++] = b;
+                result[count++] = c;
+            }
+        }
+        result.resize(count);
+    }
+
+    if (resultError)
+        *resultError = (float) std::sqrt(worstError);
+    return result;
+}
+
+void generateLods(MeshData &mesh, const std::string &name)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    MeshLod full = { 0, (GLuint) mesh.indices.size(), 0 };
+    mesh.lods.assign(1, full);
+    if (mesh.vertices.empty())
+        return;
+
+    gl::Vector3 minimum = mesh.vertices[0].position;
+    gl::Vector3 maximum = minimum;
+    for (const Vertex &vertex : mesh.vertices)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            minimum[c] = std::min(minimum[c], vertex.position[c]);
+            maximum[c] = std::max(maximum[c], vertex.position[c]);
+        }
+    }
+
+    // Levels coarser than this are not worth keeping at any distance
+    float maxError = (maximum - minimum).length() * 0.05f;
+
+    std::vector<GLuint> previous(mesh.indices);
+    float previousError = 0;
+    while (mesh.lods.size() < MAX_MESH_LODS)
+    {
+        float error;
+        std::vector<GLuint> level = simplifyMesh(mesh.vertices, previous, previous.size() / 2, maxError, &error);
+
+        // Stop once a level no longer removes a quarter of the triangles
+        if (level.empty() || level.size() > previous.size() * 3 / 4)
+            break;
+
+        optimizeVertexCache(level, mesh.vertices.size());
+
+        // Errors accumulate from one level to the next
+        previousError += error;
+        MeshLod lod = { (GLuint) mesh.indices.size(), (GLuint) level.size(), previousError };
+        mesh.lods.push_back(lod);
+        mesh.indices.insert(mesh.indices.end(), level.begin(), level.end());
+        previous.swap(level);
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::ostringstream message;
+    message << "Generated LODs for '" << name << "' triangles:";
+    for (const MeshLod &lod : mesh.lods)
+        message << " " << lod.indexCount / 3;
+    message << " error:";
+    for (const MeshLod &lod : mesh.lods)
+        message << " " << lod.error;
+    message << " time: " << seconds * 1000 << " ms" << std::endl;
+    std::cout << message.str();
+}
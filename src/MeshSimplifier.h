@@ -0,0 +1,25 @@
+
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <string>
+#include <vector>
+
+#include "ObjLoader.h"
+
+// Quadric error metric edge-collapse simplifier (Garland and Heckbert).
+// Vertices collapse onto existing neighbours, so every level of detail
+// shares the source vertex buffer and only the index buffer changes.
+// Vertices on open borders and on attribute seams, where several vertices
+// share a position, never move. Stops at targetIndexCount or when the next
+// collapse would exceed maxError. resultError receives the largest error
+// introduced, in object-space units.
+std::vector<GLuint> simplifyMesh(const std::vector<Vertex> &vertices, const std::vector<GLuint> &indices,
+                                 size_t targetIndexCount, float maxError, float *resultError = 0);
+
+// Appends up to MAX_MESH_LODS - 1 simplified levels to mesh.indices, each
+// half the triangles of the previous one, and fills mesh.lods. Level 0 is
+// the original index range.
+void generateLods(MeshData &mesh, const std::string &name);
+
+#endif
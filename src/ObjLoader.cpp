@@ -0,0 +1,905 @@
+
+#include "ObjLoader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+    const double POWERS_OF_TEN[] =
+    {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+        1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+        1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    inline bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    inline bool isDigit(char c)
+    {
+        return (unsigned char) (c - '0') < 10;
+    }
+
+    inline const char *skipSpace(const char *p, const char *end)
+    {
+        while (p < end && isSpace(*p))
+            ++p;
+        return p;
+    }
+
+    inline const char *skipLine(const char *p, const char *end)
+    {
+        const char *newline = (const char *) memchr(p, '\n', end - p);
+        return newline ? newline + 1 : end;
+    }
+
+    double scaleByPowerOfTen(double value, int exponent)
+    {
+        while (exponent > 22)
+        {
+            value *= 1e22;
+            exponent -= 22;
+        }
+        while (exponent < -22)
+        {
+            value /= 1e22;
+            exponent += 22;
+        }
+        return exponent >= 0 ? value * POWERS_OF_TEN[exponent] : value / POWERS_OF_TEN[-exponent];
+    }
+}
+
+// Up to 19 significant digits are accumulated exactly, which is well beyond
+// float precision.
+const char *parseFloat(const char *p, const char *end, float &out)
+{
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool any = false;
+
+    for (; p < end && isDigit(*p); ++p, any = true)
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa)
+                ++digits;
+        }
+        else
+            ++exponent;
+    }
+
+    if (p < end && *p == '.')
+    {
+        for (++p; p < end && isDigit(*p); ++p, any = true)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa)
+                    ++digits;
+                --exponent;
+            }
+        }
+    }
+
+    if (!any)
+        return start;
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char *e = p + 1;
+        bool negativeExponent = false;
+        if (e < end && (*e == '-' || *e == '+'))
+            negativeExponent = *e++ == '-';
+        if (e < end && isDigit(*e))
+        {
+            int value = 0;
+            for (; e < end && isDigit(*e); ++e)
+                if (value < 10000)
+                    value = value * 10 + (*e - '0');
+            exponent += negativeExponent ? -value : value;
+            p = e;
+        }
+    }
+
+    double value = scaleByPowerOfTen((double) mantissa, exponent);
+    out = (float) (negative ? -value : value);
+    return p;
+}
+
+const char *parseInt(const char *p, const char *end, int &out)
+{
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    if (p == end || !isDigit(*p))
+        return start;
+
+    int value = 0;
+    for (; p < end && isDigit(*p); ++p)
+        value = value * 10 + (*p - '0');
+    out = negative ? -value : value;
+    return p;
+}
+
+namespace
+{
+    template <typename VectorType>
+    const char *parseVector(const char *p, const char *end, VectorType &v, int components)
+    {
+        for (int i = 0; i < components; ++i)
+            p = parseFloat(skipSpace(p, end), end, v[i]);
+        return p;
+    }
+
+    struct Attributes
+    {
+        std::vector<gl::Vector3> positions;
+        std::vector<gl::Vector2> textureCoords;
+        std::vector<gl::Vector3> normals;
+    };
+
+    // Open-addressing map from a (v, vt, vn) corner to its unique vertex index.
+    class VertexCache
+    {
+    public:
+        VertexCache() : m_count(0)
+        {
+            m_slots.resize(1024);
+        }
+
+        // Returns the index stored for the corner, or inserts and returns
+        // nextIndex when the corner has not been seen before.
+        GLuint insert(int v, int vt, int vn, GLuint nextIndex)
+        {
+            if ((m_count + 1) * 2 > m_slots.size())
+                grow();
+
+            size_t mask = m_slots.size() - 1;
+            for (size_t i = hash(v, vt, vn) & mask; ; i = (i + 1) & mask)
+            {
+                Slot &slot = m_slots[i];
+                if (slot.v == 0)
+                {
+                    slot.v = v;
+                    slot.vt = vt;
+                    slot.vn = vn;
+                    slot.index = nextIndex;
+                    ++m_count;
+                    return nextIndex;
+                }
+                if (slot.v == v && slot.vt == vt && slot.vn == vn)
+                    return slot.index;
+            }
+        }
+
+    private:
+        struct Slot
+        {
+            Slot() : v(0), vt(0), vn(0), index(0) {}
+            int v, vt, vn;
+            GLuint index;
+        };
+
+        static size_t hash(int v, int vt, int vn)
+        {
+            size_t h = (size_t) v * 73856093u;
+            h ^= (size_t) vt * 19349663u;
+            h ^= (size_t) vn * 83492791u;
+            return h ^ (h >> 16);
+        }
+
+        void grow()
+        {
+            std::vector<Slot> old;
+            old.swap(m_slots);
+            m_slots.resize(old.size() * 2);
+            m_count = 0;
+            for (const Slot &slot : old)
+                if (slot.v != 0)
+                    insert(slot.v, slot.vt, slot.vn, slot.index);
+        }
+
+        std::vector<Slot> m_slots;
+        size_t m_count;
+    };
+
+    // Indices are 1-based. After resolveChunk, vt == 0 marks a missing
+    // texture coordinate and vn == 0 a missing normal; generateNormals then
+    // points missing normals at generated ones with vn = -(index + 1).
+    struct Corner
+    {
+        int v, vt, vn;
+    };
+
+    // Attribute counts of a chunk at the point one of its faces was parsed.
+    // Added to the chunk's global offset this gives the bound that the serial
+    // parser would have checked the face's indices against, and the base
+    // that negative indices count back from.
+    struct FaceStart
+    {
+        GLuint positions, textureCoords, normals;
+    };
+
+    // Smoothing group 0 ("s off") gets flat normals. Faces before the first
+    // "s" line of a chunk inherit the group the previous chunk ended with.
+    const int SMOOTHING_OFF = 0;
+    const int SMOOTHING_INHERIT = -1;
+
+    struct Face
+    {
+        FaceStart start;
+        GLuint cornerCount;
+        int smoothingGroup;
+    };
+
+    // A triangulated face with at least one corner missing its normal
+    struct GeneratedFace
+    {
+        size_t firstCorner;
+        size_t cornerCount;
+        int smoothingGroup;
+    };
+
+    struct Chunk
+    {
+        Chunk() : begin(0), end(0), lines(0), smoothingGroup(SMOOTHING_INHERIT), incomingSmoothingGroup(SMOOTHING_OFF) {}
+
+        const char *begin;
+        const char *end;
+        size_t lines;
+
+        Attributes attributes;
+        std::vector<Corner> corners;
+        std::vector<Face> faces;
+        int smoothingGroup;
+
+        FaceStart offset;
+        int incomingSmoothingGroup;
+        std::vector<Corner> resolved;
+        std::vector<GeneratedFace> generated;
+        size_t firstVertex;
+    };
+
+    const size_t MIN_CHUNK_BYTES = 1 << 20;
+
+    template <typename Function>
+    void parallelFor(size_t count, Function function)
+    {
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < count; ++i)
+            workers.push_back(std::thread(function, i));
+        if (count > 0)
+            function(0);
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    // Splits the buffer into at most threadCount pieces that all end on a
+    // line boundary.
+    std::vector<Chunk> splitChunks(const char *begin, const char *end, unsigned int threadCount)
+    {
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+        size_t size = end - begin;
+        size_t count = std::min<size_t>(threadCount, size / MIN_CHUNK_BYTES + 1);
+
+        std::vector<Chunk> chunks(count);
+        const char *p = begin;
+        for (size_t i = 0; i < count; ++i)
+        {
+            chunks[i].begin = p;
+            p = i + 1 == count ? end : std::max(p, begin + size * (i + 1) / count);
+            if (p < end)
+                p = skipLine(p, end);
+            chunks[i].end = p;
+        }
+        return chunks;
+    }
+
+    // Appends the v, v/vt, v//vn or v/vt/vn corners that follow "f" up to the
+    // end of the line and returns how many there were.
+    GLuint parseFace(const char *p, const char *end, std::vector<Corner> &corners)
+    {
+        GLuint count = 0;
+        for (p = skipSpace(p, end); ; p = skipSpace(p, end))
+        {
+            Corner corner = { 0, 0, 0 };
+            const char *next = parseInt(p, end, corner.v);
+            if (next == p)
+                break;
+            p = next;
+            if (p < end && *p == '/')
+                p = parseInt(p + 1, end, corner.vt);
+            if (p < end && *p == '/')
+                p = parseInt(p + 1, end, corner.vn);
+            corners.push_back(corner);
+            ++count;
+        }
+        return count;
+    }
+
+    enum LineType
+    {
+        OTHER_LINE,
+        POSITION_LINE,
+        TEXTURE_COORD_LINE,
+        NORMAL_LINE,
+        FACE_LINE,
+        SMOOTHING_LINE
+    };
+
+    // Classifies the line starting at p, which must be past any leading
+    // space. Sets data to the first character after the keyword.
+    inline LineType lineType(const char *p, const char *end, const char *&data)
+    {
+        if (p + 1 >= end)
+            return OTHER_LINE;
+
+        data = p + 2;
+        if (p[0] == 'v' && isSpace(p[1]))
+            return POSITION_LINE;
+        if (p[0] == 'f' && isSpace(p[1]))
+            return FACE_LINE;
+        if (p[0] == 's' && isSpace(p[1]))
+            return SMOOTHING_LINE;
+
+        data = p + 3;
+        if (p[0] == 'v' && p[1] == 't' && p + 2 < end && isSpace(p[2]))
+            return TEXTURE_COORD_LINE;
+        if (p[0] == 'v' && p[1] == 'n' && p + 2 < end && isSpace(p[2]))
+            return NORMAL_LINE;
+        return OTHER_LINE;
+    }
+
+    void parseChunk(Chunk &chunk)
+    {
+        const char *end = chunk.end;
+        Attributes &attributes = chunk.attributes;
+
+        for (const char *p = chunk.begin; p < end; p = skipLine(p, end), ++chunk.lines)
+        {
+            p = skipSpace(p, end);
+            const char *data;
+            switch (lineType(p, end, data))
+            {
+            case POSITION_LINE:
+            {
+                gl::Vector3 v;
+                parseVector(data, end, v, 3);
+                attributes.positions.push_back(v);
+                break;
+            }
+            case TEXTURE_COORD_LINE:
+            {
+                gl::Vector2 vt;
+                parseVector(data, end, vt, 2);
+                attributes.textureCoords.push_back(vt);
+                break;
+            }
+            case NORMAL_LINE:
+            {
+                gl::Vector3 vn;
+                parseVector(data, end, vn, 3);
+                attributes.normals.push_back(vn);
+                break;
+            }
+            case FACE_LINE:
+            {
+                Face face;
+                face.start.positions = (GLuint) attributes.positions.size();
+                face.start.textureCoords = (GLuint) attributes.textureCoords.size();
+                face.start.normals = (GLuint) attributes.normals.size();
+                face.cornerCount = parseFace(data, end, chunk.corners);
+                face.smoothingGroup = chunk.smoothingGroup;
+                chunk.faces.push_back(face);
+                break;
+            }
+            case SMOOTHING_LINE:
+            {
+                int group = SMOOTHING_OFF;
+                parseInt(skipSpace(data, end), end, group);
+                chunk.smoothingGroup = std::max(group, SMOOTHING_OFF);
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    }
+
+    // Turns a 1-based or negative (relative) index into a 1-based one. count
+    // is the number of values defined before the face. Returns 0 for an
+    // absent index and -1 for one out of range.
+    inline int resolveIndex(int index, GLuint count)
+    {
+        if (index > 0)
+            return (GLuint) index <= count ? index : -1;
+        if (index < 0)
+            return (int) count + index >= 0 ? (int) count + index + 1 : -1;
+        return 0;
+    }
+
+    // Resolves the corners of a face against the attribute counts at the
+    // face into polygon. Returns false for faces with fewer than three
+    // corners or an index out of range.
+    bool resolveFace(const Corner *corners, GLuint count, const FaceStart &counts, std::vector<Corner> &polygon, bool &missingNormal)
+    {
+        polygon.clear();
+        missingNormal = false;
+        if (count < 3)
+            return false;
+
+        for (GLuint i = 0; i < count; ++i)
+        {
+            Corner corner;
+            corner.v = resolveIndex(corners[i].v, counts.positions);
+            corner.vt = resolveIndex(corners[i].vt, counts.textureCoords);
+            corner.vn = resolveIndex(corners[i].vn, counts.normals);
+            if (corner.v <= 0 || corner.vt < 0 || corner.vn < 0)
+                return false;
+            missingNormal = missingNormal || corner.vn == 0;
+            polygon.push_back(corner);
+        }
+        return true;
+    }
+
+    // Keeps the faces whose indices were in range when they were read and
+    // fan-triangulates them. Faces with a missing normal are recorded for
+    // generateNormals.
+    void resolveChunk(Chunk &chunk)
+    {
+        std::vector<Corner> polygon;
+        chunk.resolved.reserve(chunk.corners.size());
+
+        const Corner *corners = chunk.corners.data();
+        for (const Face &face : chunk.faces)
+        {
+            const Corner *faceCorners = corners;
+            corners += face.cornerCount;
+
+            FaceStart counts;
+            counts.positions = chunk.offset.positions + face.start.positions;
+            counts.textureCoords = chunk.offset.textureCoords + face.start.textureCoords;
+            counts.normals = chunk.offset.normals + face.start.normals;
+
+            bool missingNormal;
+            if (!resolveFace(faceCorners, face.cornerCount, counts, polygon, missingNormal))
+                continue;
+
+            if (missingNormal)
+            {
+                GeneratedFace generated;
+                generated.firstCorner = chunk.resolved.size();
+                generated.cornerCount = (face.cornerCount - 2) * 3;
+                generated.smoothingGroup = face.smoothingGroup == SMOOTHING_INHERIT
+                    ? chunk.incomingSmoothingGroup : face.smoothingGroup;
+                chunk.generated.push_back(generated);
+            }
+
+            for (size_t i = 1; i + 1 < polygon.size(); ++i)
+            {
+                chunk.resolved.push_back(polygon[0]);
+                chunk.resolved.push_back(polygon[i]);
+                chunk.resolved.push_back(polygon[i + 1]);
+            }
+        }
+        std::vector<Corner>().swap(chunk.corners);
+        std::vector<Face>().swap(chunk.faces);
+    }
+
+    template <typename T>
+    void gatherAttribute(std::vector<Chunk> &chunks, std::vector<T> Attributes::*member, GLuint FaceStart::*offset, std::vector<T> &out, size_t i)
+    {
+        std::vector<T> &values = chunks[i].attributes.*member;
+        std::copy(values.begin(), values.end(), out.begin() + chunks[i].offset.*offset);
+        std::vector<T>().swap(values);
+    }
+
+    // Parses all chunks in parallel, then stitches their attributes together
+    // using prefix sums of the per-chunk counts.
+    size_t parseChunks(std::vector<Chunk> &chunks, Attributes &attributes)
+    {
+        parallelFor(chunks.size(), [&](size_t i) { parseChunk(chunks[i]); });
+
+        FaceStart total = { 0, 0, 0 };
+        int smoothingGroup = SMOOTHING_OFF;
+        size_t lines = 0;
+        for (Chunk &chunk : chunks)
+        {
+            chunk.offset = total;
+            chunk.incomingSmoothingGroup = smoothingGroup;
+            total.positions += (GLuint) chunk.attributes.positions.size();
+            total.textureCoords += (GLuint) chunk.attributes.textureCoords.size();
+            total.normals += (GLuint) chunk.attributes.normals.size();
+            if (chunk.smoothingGroup != SMOOTHING_INHERIT)
+                smoothingGroup = chunk.smoothingGroup;
+            lines += chunk.lines;
+        }
+
+        if (chunks.size() == 1)
+            std::swap(attributes, chunks[0].attributes);
+        else
+        {
+            attributes.positions.resize(total.positions);
+            attributes.textureCoords.resize(total.textureCoords);
+            attributes.normals.resize(total.normals);
+        }
+
+        parallelFor(chunks.size(), [&](size_t i)
+        {
+            if (chunks.size() > 1)
+            {
+                gatherAttribute(chunks, &Attributes::positions, &FaceStart::positions, attributes.positions, i);
+                gatherAttribute(chunks, &Attributes::textureCoords, &FaceStart::textureCoords, attributes.textureCoords, i);
+                gatherAttribute(chunks, &Attributes::normals, &FaceStart::normals, attributes.normals, i);
+            }
+            resolveChunk(chunks[i]);
+        });
+
+        return lines;
+    }
+
+    // Builds normals for corners that have none: one per face outside a
+    // smoothing group, otherwise one per position and group, accumulated
+    // from the area-weighted normals of the triangles that share it.
+    std::vector<gl::Vector3> generateNormals(std::vector<Chunk> &chunks, const Attributes &attributes)
+    {
+        std::vector<gl::Vector3> normals;
+        VertexCache smooth;
+
+        for (Chunk &chunk : chunks)
+        {
+            for (const GeneratedFace &face : chunk.generated)
+            {
+                Corner *corners = &chunk.resolved[face.firstCorner];
+                GLuint flat = (GLuint) normals.size();
+                if (face.smoothingGroup == SMOOTHING_OFF)
+                    normals.push_back(gl::Vector3(0, 0, 0));
+
+                for (size_t i = 0; i < face.cornerCount; i += 3)
+                {
+                    const gl::Vector3 &p0 = attributes.positions[corners[i + 0].v - 1];
+                    const gl::Vector3 &p1 = attributes.positions[corners[i + 1].v - 1];
+                    const gl::Vector3 &p2 = attributes.positions[corners[i + 2].v - 1];
+                    gl::Vector3 normal = gl::cross(p1 - p0, p2 - p0);
+
+                    for (size_t k = i; k < i + 3; ++k)
+                    {
+                        if (corners[k].vn != 0)
+                            continue;
+
+                        GLuint index = flat;
+                        if (face.smoothingGroup != SMOOTHING_OFF)
+                        {
+                            index = smooth.insert(corners[k].v, face.smoothingGroup, 0, (GLuint) normals.size());
+                            if (index == normals.size())
+                                normals.push_back(gl::Vector3(0, 0, 0));
+                        }
+                        normals[index] = normals[index] + normal;
+                        corners[k].vn = -(int) index - 1;
+                    }
+                }
+            }
+            std::vector<GeneratedFace>().swap(chunk.generated);
+        }
+
+        for (gl::Vector3 &normal : normals)
+        {
+            float length = normal.length();
+            normal = length > 0 ? normal / length : gl::Vector3(0, 1, 0);
+        }
+        return normals;
+    }
+
+    inline Vertex makeVertex(const Attributes &attributes, const std::vector<gl::Vector3> &generatedNormals, const Corner &corner)
+    {
+        Vertex vertex;
+        vertex.position = attributes.positions[corner.v - 1];
+        vertex.textureCoord = corner.vt ? attributes.textureCoords[corner.vt - 1] : gl::Vector2(0, 0);
+        vertex.normal = corner.vn > 0 ? attributes.normals[corner.vn - 1] : generatedNormals[-corner.vn - 1];
+        return vertex;
+    }
+}
+
+std::vector<Vertex> ParseOBJ(const char *begin, const char *end, size_t *lineCount, unsigned int threadCount)
+{
+    std::vector<Chunk> chunks = splitChunks(begin, end, threadCount);
+    Attributes attributes;
+    size_t lines = parseChunks(chunks, attributes);
+    std::vector<gl::Vector3> generatedNormals = generateNormals(chunks, attributes);
+
+    size_t total = 0;
+    for (Chunk &chunk : chunks)
+    {
+        chunk.firstVertex = total;
+        total += chunk.resolved.size();
+    }
+
+    std::vector<Vertex> vertices(total);
+    parallelFor(chunks.size(), [&](size_t i)
+    {
+        Vertex *out = vertices.data() + chunks[i].firstVertex;
+        for (const Corner &corner : chunks[i].resolved)
+            *out++ = makeVertex(attributes, generatedNormals, corner);
+    });
+
+    if (lineCount)
+        *lineCount = lines;
+
+    return vertices;
+}
+
+MeshData ParseIndexedOBJ(const char *begin, const char *end, size_t *lineCount, unsigned int threadCount)
+{
+    std::vector<Chunk> chunks = splitChunks(begin, end, threadCount);
+    Attributes attributes;
+    size_t lines = parseChunks(chunks, attributes);
+    std::vector<gl::Vector3> generatedNormals = generateNormals(chunks, attributes);
+
+    MeshData mesh;
+    VertexCache cache;
+    for (const Chunk &chunk : chunks)
+    {
+        for (const Corner &corner : chunk.resolved)
+        {
+            GLuint next = (GLuint) mesh.vertices.size();
+            GLuint index = cache.insert(corner.v, corner.vt, corner.vn, next);
+            if (index == next)
+                mesh.vertices.push_back(makeVertex(attributes, generatedNormals, corner));
+            mesh.indices.push_back(index);
+        }
+    }
+
+    if (lineCount)
+        *lineCount = lines;
+
+    return mesh;
+}
+
+std::vector<Vertex> LoadOBJ(const std::string &filename, unsigned int threadCount)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    MappedFile file(filename);
+    if (!file.isOpen())
+        fatalError("Could not open file '" + filename + "'");
+    size_t lines = 0;
+    std::vector<Vertex> vertices = ParseOBJ(file.begin(), file.end(), &lines, threadCount);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (vertices.size() == 0)
+        fatalError("Failed to load model '" + filename + "'");
+    std::ostringstream message;
+    message << "Loaded Model '" << filename << "' vertices: " << vertices.size()
+            << " lines: " << lines << " time: " << seconds * 1000 << " ms ("
+            << (seconds > 0 ? lines / seconds : 0) << " lines/s)" << std::endl;
+    std::cout << message.str();
+
+    return vertices;
+}
+
+MeshData LoadIndexedOBJ(const std::string &filename, unsigned int threadCount)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    MappedFile file(filename);
+    if (!file.isOpen())
+        fatalError("Could not open file '" + filename + "'");
+    size_t lines = 0;
+    MeshData mesh = ParseIndexedOBJ(file.begin(), file.end(), &lines, threadCount);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (mesh.indices.size() == 0)
+        fatalError("Failed to load model '" + filename + "'");
+
+    size_t expandedBytes = mesh.indices.size() * sizeof(Vertex);
+    size_t indexedBytes = mesh.vertices.size() * sizeof(Vertex) +
+                          mesh.indices.size() * indexSize(indexType(mesh.vertices.size()));
+    std::ostringstream message;
+    message << "Loaded Model '" << filename << "' vertices: " << mesh.indices.size()
+            << " -> " << mesh.vertices.size() << " unique, indices: " << mesh.indices.size()
+            << " memory: " << expandedBytes << " -> " << indexedBytes << " bytes"
+            << " lines: " << lines << " time: " << seconds * 1000 << " ms ("
+            << (seconds > 0 ? lines / seconds : 0) << " lines/s)" << std::endl;
+    std::cout << message.str();
+
+    return mesh;
+}
+
+ObjStreamReader::ObjStreamReader()
+    : m_budget(0), m_cursor(0), m_released(0), m_maxVertexCount(0), m_lines(0),
+      m_positionCount(0), m_textureCoordCount(0), m_normalCount(0), m_pendingOffset(0)
+{
+}
+
+bool ObjStreamReader::open(const std::string &filename, size_t budget)
+{
+    if (!m_file.open(filename))
+        return false;
+
+    m_budget = std::max<size_t>(budget, 1);
+    const char *end = m_file.end();
+
+    // Count first so that each attribute array is allocated exactly once
+    size_t positionCount = 0;
+    size_t textureCoordCount = 0;
+    size_t normalCount = 0;
+    std::vector<Corner> corners;
+    m_released = m_file.begin();
+    for (const char *p = m_file.begin(); p < end; p = skipLine(p, end), ++m_lines)
+    {
+        release(p);
+        const char *data;
+        switch (lineType(skipSpace(p, end), end, data))
+        {
+        case POSITION_LINE: ++positionCount; break;
+        case TEXTURE_COORD_LINE: ++textureCoordCount; break;
+        case NORMAL_LINE: ++normalCount; break;
+        case FACE_LINE:
+        {
+            corners.clear();
+            GLuint count = parseFace(data, end, corners);
+            if (count >= 3)
+                m_maxVertexCount += (count - 2) * 3;
+            break;
+        }
+        default: break;
+        }
+    }
+
+    m_positions.reserve(positionCount);
+    m_textureCoords.reserve(textureCoordCount);
+    m_normals.reserve(normalCount);
+    m_released = m_file.begin();
+    for (const char *p = m_file.begin(); p < end; p = skipLine(p, end))
+    {
+        release(p);
+        const char *data;
+        switch (lineType(skipSpace(p, end), end, data))
+        {
+        case POSITION_LINE:
+        {
+            gl::Vector3 v;
+            parseVector(data, end, v, 3);
+            m_positions.push_back(v);
+            break;
+        }
+        case TEXTURE_COORD_LINE:
+        {
+            gl::Vector2 vt;
+            parseVector(data, end, vt, 2);
+            m_textureCoords.push_back(vt);
+            break;
+        }
+        case NORMAL_LINE:
+        {
+            gl::Vector3 vn;
+            parseVector(data, end, vn, 3);
+            m_normals.push_back(vn);
+            break;
+        }
+        default: break;
+        }
+    }
+
+    m_cursor = m_released = m_file.begin();
+    return true;
+}
+
+size_t ObjStreamReader::read(Vertex *out, size_t count, GLuint *positionIndices)
+{
+    const char *end = m_file.end();
+    std::vector<Corner> corners;
+    std::vector<Corner> polygon;
+
+    size_t written = 0;
+    while (written < count)
+    {
+        if (m_pendingOffset < m_pending.size())
+        {
+            size_t copied = std::min(count - written, m_pending.size() - m_pendingOffset);
+            std::copy(m_pending.begin() + m_pendingOffset, m_pending.begin() + m_pendingOffset + copied, out + written);
+            if (positionIndices)
+            {
+                std::copy(m_pendingPositions.begin() + m_pendingOffset, m_pendingPositions.begin() + m_pendingOffset + copied,
+                          positionIndices + written);
+            }
+            m_pendingOffset += copied;
+            written += copied;
+            continue;
+        }
+        if (m_cursor >= end)
+            break;
+
+        const char *p = skipSpace(m_cursor, end);
+        m_cursor = skipLine(m_cursor, end);
+
+        const char *data;
+        switch (lineType(p, end, data))
+        {
+        case POSITION_LINE: ++m_positionCount; break;
+        case TEXTURE_COORD_LINE: ++m_textureCoordCount; break;
+        case NORMAL_LINE: ++m_normalCount; break;
+        case FACE_LINE:
+        {
+            corners.clear();
+            GLuint cornerCount = parseFace(data, end, corners);
+            FaceStart counts = { m_positionCount, m_textureCoordCount, m_normalCount };
+            bool missingNormal;
+            if (!resolveFace(corners.data(), cornerCount, counts, polygon, missingNormal))
+                break;
+
+            gl::Vector3 flat(0, 0, 0);
+            if (missingNormal)
+            {
+                const gl::Vector3 &p0 = m_positions[polygon[0].v - 1];
+                for (size_t i = 1; i + 1 < polygon.size(); ++i)
+                    flat = flat + gl::cross(m_positions[polygon[i].v - 1] - p0, m_positions[polygon[i + 1].v - 1] - p0);
+                float length = flat.length();
+                flat = length > 0 ? flat / length : gl::Vector3(0, 1, 0);
+            }
+
+            m_pending.clear();
+            m_pendingPositions.clear();
+            m_pendingOffset = 0;
+            for (size_t i = 1; i + 1 < polygon.size(); ++i)
+            {
+                const Corner triangle[3] = { polygon[0], polygon[i], polygon[i + 1] };
+                for (const Corner &corner : triangle)
+                {
+                    Vertex vertex;
+                    vertex.position = m_positions[corner.v - 1];
+                    vertex.textureCoord = corner.vt ? m_textureCoords[corner.vt - 1] : gl::Vector2(0, 0);
+                    vertex.normal = corner.vn ? m_normals[corner.vn - 1] : flat;
+                    m_pending.push_back(vertex);
+                    m_pendingPositions.push_back(corner.v - 1);
+                }
+            }
+            break;
+        }
+        default: break;
+        }
+    }
+
+    release(m_cursor);
+    return written;
+}
+
+void ObjStreamReader::release(const char *p)
+{
+    if ((size_t) (p - m_released) >= m_budget)
+    {
+        m_file.discard(m_released, p);
+        m_released = p;
+    }
+}
+
+GLenum indexType(size_t vertexCount)
+{
+    return vertexCount <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+size_t indexSize(GLenum type)
+{
+    return type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
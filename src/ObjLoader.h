@@ -0,0 +1,90 @@
+
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <string>
+#include <vector>
+
+#include "Util.h"
+
+struct MeshData
+{
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+
+    // Empty until generateLods has appended the simplified levels
+    std::vector<MeshLod> lods;
+};
+
+// threadCount limits how many worker threads parse the file; 0 uses one per
+// hardware thread. Small files are always parsed on the calling thread.
+// Polygons are fan-triangulated, negative indices count back from the last
+// value read, and faces without normals get flat normals, or smooth ones
+// inside an "s" smoothing group. Faces with out-of-range indices are skipped.
+std::vector<Vertex> LoadOBJ(const std::string &filename, unsigned int threadCount = 0);
+std::vector<Vertex> ParseOBJ(const char *begin, const char *end, size_t *lineCount = 0, unsigned int threadCount = 0);
+
+MeshData LoadIndexedOBJ(const std::string &filename, unsigned int threadCount = 0);
+MeshData ParseIndexedOBJ(const char *begin, const char *end, size_t *lineCount = 0, unsigned int threadCount = 0);
+
+// Reads the triangles of an OBJ file a few at a time so that the expanded
+// vertices never have to be held in memory at once. The attributes are
+// parsed up front because faces may reference any of them. Faces without
+// normals get flat normals, since smoothing groups need the whole mesh.
+// Mapped pages already read are released every budget bytes.
+class ObjStreamReader
+{
+public:
+    ObjStreamReader();
+
+    // Counts the faces and parses the attributes. Returns false if the file
+    // could not be opened.
+    bool open(const std::string &filename, size_t budget);
+
+    // Fills out with up to count vertices, three per triangle. A triangle
+    // may be split across calls. Returns 0 once the file is exhausted. If
+    // given, positionIndices receives the index into positions() of each
+    // vertex.
+    size_t read(Vertex *out, size_t count, GLuint *positionIndices = 0);
+
+    // Upper bound on the total read() produces; faces with out-of-range
+    // indices are counted but skipped.
+    size_t maxVertexCount() const { return m_maxVertexCount; }
+    size_t lines() const { return m_lines; }
+    const std::vector<gl::Vector3> &positions() const { return m_positions; }
+
+private:
+    void release(const char *p);
+
+    MappedFile m_file;
+    size_t m_budget;
+    const char *m_cursor;
+    const char *m_released;
+
+    std::vector<gl::Vector3> m_positions;
+    std::vector<gl::Vector2> m_textureCoords;
+    std::vector<gl::Vector3> m_normals;
+    size_t m_maxVertexCount;
+    size_t m_lines;
+
+    // Attribute counts seen by read() so far
+    GLuint m_positionCount;
+    GLuint m_textureCoordCount;
+    GLuint m_normalCount;
+
+    // Vertices of the last face that did not fit in out
+    std::vector<Vertex> m_pending;
+    std::vector<GLuint> m_pendingPositions;
+    size_t m_pendingOffset;
+};
+
+// Parse a decimal number starting at p without going through the C locale
+// and return the first character after it, or p unchanged when no number is
+// present.
+const char *parseFloat(const char *p, const char *end, float &out);
+const char *parseInt(const char *p, const char *end, int &out);
+
+GLenum indexType(size_t vertexCount);
+size_t indexSize(GLenum type);
+
+#endif
@@ -0,0 +1,55 @@
+
+#include "Picking.h"
+#include "MeshRegistry.h"
+
+float intersectEntity(const Entity &entity, const gl::Vector3 &origin, const gl::Vector3 &direction, float maxDistance)
+{
+    gl::Matrix4 toObject = entityTransform(entity);
+    if (!toObject.invert())
+        return -1;
+
+    // Distances along the object space ray match the world space ones
+    gl::Vector3 objectOrigin(toObject * gl::Vector4(origin, 1));
+    gl::Vector3 objectDirection(toObject * gl::Vector4(direction, 0));
+
+    // A mirroring scale swaps which faces are culled
+    GLenum cull = entity.cull;
+    if (cull != GL_NONE && entity.scale[0] * entity.scale[1] * entity.scale[2] < 0)
+        cull = cull == GL_BACK ? GL_FRONT : GL_BACK;
+
+    Ray ray = { objectOrigin, objectDirection, maxDistance };
+    TriangleHit hit;
+    return meshes.raycast(entity.mesh, ray, hit, cull) ? hit.distance : -1;
+}
+
+GLuint pickEntity(const std::vector<Entity> &entities, const EntityBvh &bvh, const gl::Matrix4 &viewProjection, float x, float y)
+{
+    gl::Matrix4 inverse = viewProjection;
+    if (!inverse.invert())
+        return 0;
+
+    // From the near plane (distance 0) to the far plane (distance 1)
+    gl::Vector4 nearPoint = inverse * gl::Vector4(x, y, -1, 1);
+    gl::Vector4 farPoint = inverse * gl::Vector4(x, y, 1, 1);
+    gl::Vector3 origin = gl::Vector3(nearPoint) / nearPoint[3];
+    gl::Vector3 direction = gl::Vector3(farPoint) / farPoint[3] - origin;
+
+    std::vector<RayHit> hits;
+    bvh.intersectRay(origin, direction, hits);
+
+    GLuint objectID = 0;
+    float nearest = 1;
+    for (const RayHit &hit : hits)
+    {
+        if (hit.distance > nearest)
+            break;
+
+        float distance = intersectEntity(entities[hit.entity], origin, direction, nearest);
+        if (distance >= 0)
+        {
+            nearest = distance;
+            objectID = entities[hit.entity].objectID;
+        }
+    }
+    return objectID;
+}
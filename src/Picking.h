@@ -0,0 +1,21 @@
+
+#ifndef PICKING_H
+#define PICKING_H
+
+#include <vector>
+
+#include "EntityBvh.h"
+#include "Util.h"
+
+// Casts a ray through a point in normalized device coordinates and returns
+// the objectID of the nearest entity triangle it hits, or 0 for none, like
+// a read from the pick framebuffer. Candidates come from the BVH in order
+// of their boxes, and faces the rasterizer would cull are skipped.
+GLuint pickEntity(const std::vector<Entity> &entities, const EntityBvh &bvh, const gl::Matrix4 &viewProjection, float x, float y);
+
+// Distance along the ray to the nearest triangle of an entity's level 0
+// mesh closer than maxDistance, in multiples of direction, or a negative
+// value on a miss.
+float intersectEntity(const Entity &entity, const gl::Vector3 &origin, const gl::Vector3 &direction, float maxDistance);
+
+#endif
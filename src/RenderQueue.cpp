@@ -0,0 +1,267 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+namespace
+{
+    // Widths of the key fields, most significant first
+    const unsigned int PROGRAM_BITS = 8;
+    const unsigned int CULL_BITS = 2;
+    const unsigned int TEXTURE_BITS = 8;
+    const unsigned int MESH_BITS = 16;
+    const unsigned int LOD_BITS = 2;
+    const unsigned int DEPTH_BITS = 28;
+    const unsigned int STATE_BITS = 64 - DEPTH_BITS;
+
+    // Front to back, depths are first compared by their exponent and top
+    // three mantissa bits, so instances within an eighth of an octave of
+    // each other can still share a draw
+    const unsigned int DEPTH_BUCKET_BITS = 11;
+    const unsigned int FINE_DEPTH_BITS = DEPTH_BITS - DEPTH_BUCKET_BITS;
+
+    const unsigned int RADIX_BITS = 8;
+    const unsigned int RADIX_PASSES = 64 / RADIX_BITS;
+
+    unsigned int cullIndex(GLenum cull)
+    {
+        return cull == GL_NONE ? 0 : cull == GL_BACK ? 1 : 2;
+    }
+
+    // Positive floats compare like their bit patterns, so the top bits of
+    // the pattern order depths without a conversion
+    uint64_t depthBits(float depth)
+    {
+        depth = std::max(depth, 0.0f);
+        uint32_t bits;
+        std::memcpy(&bits, &depth, sizeof(bits));
+        return bits >> (31 - DEPTH_BITS);
+    }
+
+    void checkField(uint64_t value, unsigned int bits, const char *name)
+    {
+        if (value >> bits)
+            fatalError(std::string("Render queue ") + name + " out of range");
+    }
+
+    void addName(std::vector<GLuint> &names, GLuint name, unsigned int bits, const char *kind)
+    {
+        if (std::find(names.begin(), names.end(), name) != names.end())
+            return;
+        checkField(names.size(), bits, kind);
+        names.push_back(name);
+    }
+
+    uint64_t nameIndex(const std::vector<GLuint> &names, GLuint name, const char *kind)
+    {
+        std::vector<GLuint>::const_iterator found = std::find(names.begin(), names.end(), name);
+        if (found == names.end())
+        {
+            std::ostringstream message;
+            message << "Render queue " << kind << " " << name << " was never added";
+            fatalError(message.str());
+        }
+        return found - names.begin();
+    }
+}
+
+StateCache::StateCache()
+    : m_uniforms(0), m_requests(0), m_changes(0)
+{
+    reset();
+}
+
+void StateCache::reset()
+{
+    m_program = UNKNOWN;
+    m_cull = UNKNOWN;
+    m_texture = UNKNOWN;
+}
+
+void StateCache::useProgram(GLuint program)
+{
+    m_requests++;
+    if (program == m_program)
+        return;
+
+    glUseProgram(program);
+    m_program = program;
+    m_uniforms = uniformLocations(program);
+    m_changes++;
+}
+
+void StateCache::setCull(GLenum cull)
+{
+    m_requests++;
+    if (cull == m_cull)
+        return;
+
+    if (cull == GL_NONE)
+        glDisable(GL_CULL_FACE);
+    else
+    {
+        if (m_cull == GL_NONE || m_cull == UNKNOWN)
+        {
+            glEnable(GL_CULL_FACE);
+            m_changes++;
+        }
+        glCullFace(cull);
+    }
+    m_cull = cull;
+    m_changes++;
+}
+
+void StateCache::bindTexture(GLuint texture)
+{
+    m_requests++;
+    if (texture == m_texture)
+        return;
+
+    if (m_texture == UNKNOWN)
+    {
+        glActiveTexture(GL_TEXTURE0);
+        m_changes++;
+    }
+    glBindTexture(GL_TEXTURE_2D, texture);
+    m_texture = texture;
+    m_changes++;
+}
+
+void StateCache::resetCounts()
+{
+    m_requests = 0;
+    m_changes = 0;
+}
+
+void RenderQueue::addProgram(GLuint program)
+{
+    addName(m_programs, program, PROGRAM_BITS, "program count");
+}
+
+void RenderQueue::addTexture(GLuint texture)
+{
+    addName(m_textures, texture, TEXTURE_BITS, "texture count");
+}
+
+void RenderQueue::push(GLuint program, GLenum cull, GLuint texture, MeshHandle mesh, unsigned int lod, float depth,
+                       const InstanceData &instance)
+{
+    checkField(mesh, MESH_BITS, "mesh");
+    checkField(lod, LOD_BITS, "LOD");
+
+    uint64_t state = nameIndex(m_programs, program, "program");
+    state = (state << CULL_BITS) | cullIndex(cull);
+    state = (state << TEXTURE_BITS) | nameIndex(m_textures, texture, "texture");
+    state = (state << MESH_BITS) | mesh;
+    state = (state << LOD_BITS) | lod;
+
+    Draw draw = { state, depthBits(depth), program, cull, texture, mesh, lod };
+    m_draws.push_back(draw);
+    m_instances.push_back(instance);
+}
+
+void RenderQueue::sort()
+{
+    // Least significant digit radix sort, skipping digits all keys share
+    m_sortBuffer.resize(m_items.size());
+    for (unsigned int pass = 0; pass < RADIX_PASSES; ++pass)
+    {
+        unsigned int shift = pass * RADIX_BITS;
+        size_t counts[1 << RADIX_BITS] = {};
+        for (const Item &item : m_items)
+            counts[(item.key >> shift) & ((1 << RADIX_BITS) - 1)]++;
+
+        if (counts[(m_items[0].key >> shift) & ((1 << RADIX_BITS) - 1)] == m_items.size())
+            continue;
+
+        size_t offset = 0;
+        for (size_t &count : counts)
+        {
+            size_t start = offset;
+            offset += count;
+            count = start;
+        }
+        for (const Item &item : m_items)
+            m_sortBuffer[counts[(item.key >> shift) & ((1 << RADIX_BITS) - 1)]++] = item;
+        m_items.swap(m_sortBuffer);
+    }
+}
+
+SubmitStats RenderQueue::submit(StateCache &state, RenderOrder order, GLuint program)
+{
+    SubmitStats stats = { 0, 0, 0 };
+    if (m_draws.empty())
+        return stats;
+
+    m_items.resize(m_draws.size());
+    for (size_t i = 0; i < m_draws.size(); ++i)
+    {
+        const Draw &draw = m_draws[i];
+        if (order == STATE_ORDER)
+            m_items[i].key = (draw.state << DEPTH_BITS) | draw.depth;
+        else
+        {
+            uint64_t bucket = draw.depth >> FINE_DEPTH_BITS;
+            uint64_t fine = draw.depth & ((1 << FINE_DEPTH_BITS) - 1);
+            m_items[i].key = (bucket << (STATE_BITS + FINE_DEPTH_BITS)) | (draw.state << FINE_DEPTH_BITS) | fine;
+        }
+        m_items[i].instance = (GLuint) i;
+    }
+    sort();
+
+    // Instances go into the buffer in key order, so each run is contiguous
+    m_sortedInstances.clear();
+    for (const Item &item : m_items)
+        m_sortedInstances.push_back(m_instances[item.instance]);
+    stats.glCalls += meshes.uploadInstances(&m_sortedInstances[0], m_sortedInstances.size());
+
+    unsigned int changes = state.changes();
+    GLuint lastProgram = 0;
+    MeshHandle mesh = INVALID_MESH;
+    for (size_t first = 0; first < m_items.size(); )
+    {
+        const Draw &draw = m_draws[m_items[first].instance];
+        size_t last = first + 1;
+        while (last < m_items.size() && m_draws[m_items[last].instance].state == draw.state)
+            ++last;
+
+        GLuint drawProgram = program ? program : draw.program;
+        state.useProgram(drawProgram);
+        state.setCull(draw.cull);
+        state.bindTexture(draw.texture);
+
+        // The mesh scale and offset are uniforms of the current program
+        if (drawProgram != lastProgram || draw.mesh != mesh)
+        {
+            const GLint *uniforms = state.uniforms();
+            const MeshEntry &entry = meshes[draw.mesh];
+            glUniform3fv(uniforms[POSITION_SCALE_UNIFORM], 1, &entry.positionScale[0]);
+            glUniform3fv(uniforms[POSITION_OFFSET_UNIFORM], 1, &entry.positionOffset[0]);
+            stats.glCalls += 2;
+            lastProgram = drawProgram;
+            mesh = draw.mesh;
+        }
+
+        if (meshes.bind(draw.mesh))
+        {
+            stats.vertexArrayBinds++;
+            stats.glCalls++;
+        }
+        stats.glCalls += meshes.bindInstances((GLuint) first);
+        meshes.drawInstanced(draw.mesh, meshes[draw.mesh].lods[draw.lod], (GLsizei) (last - first));
+        stats.draws++;
+        stats.glCalls++;
+
+        first = last;
+    }
+    stats.glCalls += state.changes() - changes;
+    return stats;
+}
+
+void RenderQueue::clear()
+{
+    m_items.clear();
+    m_draws.clear();
+    m_instances.clear();
+}
@@ -0,0 +1,121 @@
+
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "MeshRegistry.h"
+#include "Util.h"
+
+// Remembers the program, cull face and unit 0 texture it last set and skips
+// setting them again. After other code changes any of them, or the active
+// texture unit, reset() must be called before the cache is used again.
+class StateCache
+{
+public:
+    StateCache();
+
+    void reset();
+
+    void useProgram(GLuint program);    // From loadProgram
+    void setCull(GLenum cull);          // GL_NONE disables culling
+    void bindTexture(GLuint texture);   // On texture unit 0
+
+    // Uniform locations of the current program, looked up only when
+    // useProgram changes it
+    const GLint *uniforms() const { return m_uniforms; }
+
+    // State changes asked for and GL calls actually made since the last
+    // resetCounts()
+    unsigned int requests() const { return m_requests; }
+    unsigned int changes() const { return m_changes; }
+    void resetCounts();
+
+private:
+    static const GLuint UNKNOWN = ~0u;
+
+    GLuint m_program;
+    const GLint *m_uniforms;
+    GLenum m_cull;
+    GLuint m_texture;
+
+    unsigned int m_requests;
+    unsigned int m_changes;
+};
+
+struct SubmitStats
+{
+    unsigned int draws;
+    unsigned int vertexArrayBinds;
+    unsigned int glCalls;   // Including the state changes
+};
+
+enum RenderOrder
+{
+    // Fewest state changes, with each state's instances front to back
+    STATE_ORDER,
+
+    // Nearest first, so hidden fragments fail the depth test before they
+    // are shaded. Only neighbours with the same state share a draw.
+    FRONT_TO_BACK_ORDER
+};
+
+// Entities queued for one frame, drawn in the order of 64-bit keys made of
+// the program, cull face, texture, mesh and level of detail, followed or
+// preceded by the view depth. Runs of instances with the same state are
+// drawn with one instanced call.
+class RenderQueue
+{
+public:
+    // GL names can be any value, so programs and textures are keyed by the
+    // order they were added in instead. Adding one twice has no effect.
+    void addProgram(GLuint program);
+    void addTexture(GLuint texture);
+
+    // program must come from loadProgram and, like texture, must have been
+    // added. depth is the view space distance in front of the camera.
+    void push(GLuint program, GLenum cull, GLuint texture, MeshHandle mesh, unsigned int lod, float depth,
+              const InstanceData &instance);
+
+    // Sorts and draws the queue. A non-zero program replaces the ones the
+    // entities were queued with, so the same queue can draw a depth
+    // pre-pass and then the main pass.
+    SubmitStats submit(StateCache &state, RenderOrder order, GLuint program = 0);
+
+    void clear();
+
+    size_t size() const { return m_draws.size(); }
+
+private:
+    struct Item
+    {
+        uint64_t key;
+        GLuint instance;    // Into m_instances
+    };
+
+    struct Draw
+    {
+        uint64_t state;     // Key fields other than depth
+        uint64_t depth;
+        GLuint program;
+        GLenum cull;
+        GLuint texture;
+        MeshHandle mesh;
+        unsigned int lod;
+    };
+
+    void sort();
+
+    // Dense key index to GL name
+    std::vector<GLuint> m_programs;
+    std::vector<GLuint> m_textures;
+
+    std::vector<Item> m_items;
+    std::vector<Item> m_sortBuffer;
+    std::vector<Draw> m_draws;      // By instance
+    std::vector<InstanceData> m_instances;
+    std::vector<InstanceData> m_sortedInstances;
+};
+
+#endif
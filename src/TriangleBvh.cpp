@@ -0,0 +1,337 @@
+
+#include "TriangleBvh.h"
+#include "Bounds.h"
+
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define TRIANGLE_BVH_SSE 1
+#include <xmmintrin.h>
+#endif
+
+struct TriangleBvh::BuildTriangle
+{
+    gl::Vector3 corners[3];
+    gl::Vector3 minimum;
+    gl::Vector3 maximum;
+    gl::Vector3 centroid;
+    GLuint index;
+};
+
+namespace
+{
+    const size_t PACKET_SIZE = 4;
+
+    // Nodes this deep are split at the median, which bounds the depth of
+    // the tree and so the traversal stack
+    const unsigned int MEDIAN_SPLIT_DEPTH = 32;
+    const unsigned int MAX_DEPTH = 64;
+}
+
+// The ray as plain floats, since the vector accessors are not inlined
+struct TriangleBvh::Traversal
+{
+    float origin[3];
+    float direction[3];
+    float inverse[3];
+    GLenum cull;
+};
+
+TriangleBvh::TriangleBvh()
+    : m_triangleCount(0)
+{
+}
+
+void TriangleBvh::build(const std::vector<gl::Vector3> &positions, const std::vector<GLuint> &indices)
+{
+    if (indices.empty())
+        build(positions.data(), sizeof(gl::Vector3), 0, GL_NONE, positions.size());
+    else
+        build(positions.data(), sizeof(gl::Vector3), indices.data(), GL_UNSIGNED_INT, indices.size());
+}
+
+void TriangleBvh::build(const gl::Vector3 *positions, size_t stride, const void *indices, GLenum indexType, size_t indexCount)
+{
+    m_nodes.clear();
+    m_packets.clear();
+    m_triangleCount = indexCount / 3;
+    if (m_triangleCount == 0)
+        return;
+
+    std::vector<BuildTriangle> triangles(m_triangleCount);
+    for (size_t t = 0; t < m_triangleCount; ++t)
+    {
+        BuildTriangle &triangle = triangles[t];
+        BuildBox box;
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            size_t i = t * 3 + corner;
+            size_t vertex = indexType == GL_UNSIGNED_SHORT ? ((const GLushort *) indices)[i] :
+                            indexType == GL_UNSIGNED_INT ? ((const GLuint *) indices)[i] : i;
+            triangle.corners[corner] = *(const gl::Vector3 *) ((const char *) positions + vertex * stride);
+            box.grow(triangle.corners[corner], triangle.corners[corner]);
+        }
+        triangle.minimum = box.minimum;
+        triangle.maximum = box.maximum;
+        triangle.centroid = (box.minimum + box.maximum) / 2;
+        triangle.index = (GLuint) t;
+    }
+
+    m_nodes.reserve(2 * (m_triangleCount + PACKET_SIZE - 1) / PACKET_SIZE);
+    m_packets.reserve((m_triangleCount + PACKET_SIZE - 1) / PACKET_SIZE * 2);
+    buildNode(triangles, 0, m_triangleCount, 0);
+}
+
+GLuint TriangleBvh::buildNode(std::vector<BuildTriangle> &triangles, size_t first, size_t count, unsigned int depth)
+{
+    GLuint node = (GLuint) m_nodes.size();
+    m_nodes.push_back(Node());
+
+    BuildBox bounds;
+    BuildBox centroids;
+    for (size_t i = first; i < first + count; ++i)
+    {
+        bounds.grow(triangles[i].minimum, triangles[i].maximum);
+        centroids.grow(triangles[i].centroid, triangles[i].centroid);
+    }
+    for (int c = 0; c < 3; ++c)
+    {
+        m_nodes[node].minimum[c] = bounds.minimum[c];
+        m_nodes[node].maximum[c] = bounds.maximum[c];
+    }
+
+    if (count <= PACKET_SIZE)
+    {
+        TrianglePacket packet = {};
+        for (size_t lane = 0; lane < count; ++lane)
+        {
+            const BuildTriangle &triangle = triangles[first + lane];
+            gl::Vector3 edge1 = triangle.corners[1] - triangle.corners[0];
+            gl::Vector3 edge2 = triangle.corners[2] - triangle.corners[0];
+            for (int c = 0; c < 3; ++c)
+            {
+                packet.v0[c][lane] = triangle.corners[0][c];
+                packet.edge1[c][lane] = edge1[c];
+                packet.edge2[c][lane] = edge2[c];
+            }
+            packet.triangle[lane] = triangle.index;
+        }
+
+        m_nodes[node].offset = (GLuint) m_packets.size();
+        m_nodes[node].count = (GLuint) count;
+        m_packets.push_back(packet);
+        return node;
+    }
+
+    // Cheapest boundary between centroid bins along any axis
+    SahSplit best = { -1, 0, 0, 0, 0 };
+    if (depth < MEDIAN_SPLIT_DEPTH)
+    {
+        SahBins bins(centroids);
+        for (size_t i = first; i < first + count; ++i)
+            bins.add(triangles[i].centroid, triangles[i].minimum, triangles[i].maximum);
+        best = bins.split();
+    }
+
+    size_t middle = first + count / 2;
+    if (best.axis >= 0)
+    {
+        BuildTriangle *boundary = std::partition(&triangles[first], &triangles[first] + count, [&](const BuildTriangle &triangle)
+        {
+            return best.first(triangle.centroid);
+        });
+        middle = boundary - &triangles[0];
+    }
+    else
+    {
+        int axis = 0;
+        gl::Vector3 extent = centroids.maximum - centroids.minimum;
+        if (extent[1] > extent[axis])
+            axis = 1;
+        if (extent[2] > extent[axis])
+            axis = 2;
+        std::nth_element(&triangles[first], &triangles[middle], &triangles[first] + count,
+                         [axis](const BuildTriangle &a, const BuildTriangle &b) { return a.centroid[axis] < b.centroid[axis]; });
+    }
+
+    buildNode(triangles, first, middle - first, depth + 1);
+    GLuint second = buildNode(triangles, middle, first + count - middle, depth + 1);
+    m_nodes[node].offset = second;
+    m_nodes[node].count = 0;
+    return node;
+}
+
+inline float TriangleBvh::intersectNode(const Node &node, const Traversal &ray, float maxDistance)
+{
+    // Slab test
+    float enter = 0;
+    float leave = maxDistance;
+    for (int c = 0; c < 3; ++c)
+    {
+        float t0 = (node.minimum[c] - ray.origin[c]) * ray.inverse[c];
+        float t1 = (node.maximum[c] - ray.origin[c]) * ray.inverse[c];
+        enter = std::max(enter, std::min(t0, t1));
+        leave = std::min(leave, std::max(t0, t1));
+    }
+    return enter <= leave ? enter : -1;
+}
+
+bool TriangleBvh::intersectPacket(const TrianglePacket &packet, const Traversal &ray, TriangleHit &hit)
+{
+    // Moller-Trumbore on four triangles at once. The determinant is positive
+    // for triangles wound counter-clockwise as seen from the ray origin.
+    float distances[4];
+    float us[4];
+    float vs[4];
+    int lanes = 0;
+
+#if TRIANGLE_BVH_SSE
+    __m128 dx = _mm_set1_ps(ray.direction[0]);
+    __m128 dy = _mm_set1_ps(ray.direction[1]);
+    __m128 dz = _mm_set1_ps(ray.direction[2]);
+    __m128 e1x = _mm_loadu_ps(packet.edge1[0]);
+    __m128 e1y = _mm_loadu_ps(packet.edge1[1]);
+    __m128 e1z = _mm_loadu_ps(packet.edge1[2]);
+    __m128 e2x = _mm_loadu_ps(packet.edge2[0]);
+    __m128 e2y = _mm_loadu_ps(packet.edge2[1]);
+    __m128 e2z = _mm_loadu_ps(packet.edge2[2]);
+
+    __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+    __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+    __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+    __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+    __m128 inverse = _mm_div_ps(_mm_set1_ps(1), det);
+
+    __m128 sx = _mm_sub_ps(_mm_set1_ps(ray.origin[0]), _mm_loadu_ps(packet.v0[0]));
+    __m128 sy = _mm_sub_ps(_mm_set1_ps(ray.origin[1]), _mm_loadu_ps(packet.v0[1]));
+    __m128 sz = _mm_sub_ps(_mm_set1_ps(ray.origin[2]), _mm_loadu_ps(packet.v0[2]));
+    __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverse);
+
+    __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+    __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+    __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+    __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverse);
+    __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverse);
+
+    __m128 zero = _mm_setzero_ps();
+    __m128 facing = ray.cull == GL_BACK ? _mm_cmpgt_ps(det, zero)
+                  : ray.cull == GL_FRONT ? _mm_cmplt_ps(det, zero)
+                  : _mm_cmpneq_ps(det, zero);
+    __m128 mask = _mm_and_ps(facing, _mm_cmpge_ps(u, zero));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1)));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(t, zero));
+    mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(hit.distance)));
+    lanes = _mm_movemask_ps(mask);
+    if (!lanes)
+        return false;
+
+    _mm_storeu_ps(distances, t);
+    _mm_storeu_ps(us, u);
+    _mm_storeu_ps(vs, v);
+#else
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        gl::Vector3 edge1(packet.edge1[0][lane], packet.edge1[1][lane], packet.edge1[2][lane]);
+        gl::Vector3 edge2(packet.edge2[0][lane], packet.edge2[1][lane], packet.edge2[2][lane]);
+        gl::Vector3 direction(ray.direction[0], ray.direction[1], ray.direction[2]);
+        gl::Vector3 p = gl::cross(direction, edge2);
+        float det = gl::dot(edge1, p);
+        if (det == 0 || (ray.cull == GL_BACK && det < 0) || (ray.cull == GL_FRONT && det > 0))
+            continue;
+
+        float inverse = 1 / det;
+        gl::Vector3 s = gl::Vector3(ray.origin[0], ray.origin[1], ray.origin[2]) -
+                        gl::Vector3(packet.v0[0][lane], packet.v0[1][lane], packet.v0[2][lane]);
+        gl::Vector3 q = gl::cross(s, edge1);
+        us[lane] = gl::dot(s, p) * inverse;
+        vs[lane] = gl::dot(direction, q) * inverse;
+        distances[lane] = gl::dot(edge2, q) * inverse;
+        if (us[lane] >= 0 && vs[lane] >= 0 && us[lane] + vs[lane] <= 1 && distances[lane] >= 0 && distances[lane] < hit.distance)
+            lanes |= 1 << lane;
+    }
+    if (!lanes)
+        return false;
+#endif
+
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        if ((lanes & (1 << lane)) && distances[lane] < hit.distance)
+        {
+            hit.distance = distances[lane];
+            hit.triangle = packet.triangle[lane];
+            hit.u = us[lane];
+            hit.v = vs[lane];
+        }
+    }
+    return true;
+}
+
+bool TriangleBvh::raycast(const Ray &ray, TriangleHit &hit, GLenum cull) const
+{
+    hit.distance = ray.maxDistance;
+    if (m_nodes.empty())
+        return false;
+
+    Traversal traversal;
+    for (int c = 0; c < 3; ++c)
+    {
+        traversal.origin[c] = ray.origin[c];
+        traversal.direction[c] = ray.direction[c];
+        traversal.inverse[c] = 1 / ray.direction[c];
+    }
+    traversal.cull = cull;
+    if (intersectNode(m_nodes[0], traversal, hit.distance) < 0)
+        return false;
+
+    // Children are visited nearest first; the farther one waits on the
+    // stack with its entry distance so it can be skipped once a closer hit
+    // is known
+    struct Entry
+    {
+        GLuint node;
+        float distance;
+    };
+    Entry stack[MAX_DEPTH];
+    unsigned int depth = 0;
+
+    bool found = false;
+    GLuint node = 0;
+    for (;;)
+    {
+        const Node &n = m_nodes[node];
+        if (n.count)
+            found |= intersectPacket(m_packets[n.offset], traversal, hit);
+        else
+        {
+            GLuint closer = node + 1;
+            GLuint farther = n.offset;
+            float closerDistance = intersectNode(m_nodes[closer], traversal, hit.distance);
+            float fartherDistance = intersectNode(m_nodes[farther], traversal, hit.distance);
+            if (closerDistance < 0 || (fartherDistance >= 0 && fartherDistance < closerDistance))
+            {
+                std::swap(closer, farther);
+                std::swap(closerDistance, fartherDistance);
+            }
+
+            if (closerDistance >= 0)
+            {
+                if (fartherDistance >= 0)
+                {
+                    Entry entry = { farther, fartherDistance };
+                    stack[depth++] = entry;
+                }
+                node = closer;
+                continue;
+            }
+        }
+
+        // Resume with the nearest postponed node that can still be closer
+        while (depth && stack[depth - 1].distance >= hit.distance)
+            --depth;
+        if (!depth)
+            break;
+        node = stack[--depth].node;
+    }
+    return found;
+}
@@ -0,0 +1,81 @@
+
+#ifndef TRIANGLE_BVH_H
+#define TRIANGLE_BVH_H
+
+#include <vector>
+
+#include "Util.h"
+
+struct Ray
+{
+    gl::Vector3 origin;
+    gl::Vector3 direction;
+    float maxDistance;      // In multiples of direction
+};
+
+struct TriangleHit
+{
+    float distance;         // In multiples of the ray direction
+    GLuint triangle;        // Index of the triangle in the mesh's level 0 indices
+    float u;                // Barycentric coordinates of the hit
+    float v;
+};
+
+// Bounding volume hierarchy over the triangles of one mesh, for ray casts
+// in object space. Nodes are stored depth first in 32 bytes each, so the
+// first child of an inner node is the next node. Each leaf holds one packet
+// of up to four triangles laid out for testing with SSE.
+class TriangleBvh
+{
+public:
+    TriangleBvh();
+
+    // Indices are triangles; empty indices mean consecutive positions are
+    void build(const std::vector<gl::Vector3> &positions, const std::vector<GLuint> &indices);
+
+    // Reads the positions stride bytes apart and the indices in place.
+    // indexType is GL_UNSIGNED_SHORT, GL_UNSIGNED_INT, or GL_NONE for
+    // consecutive positions, indexCount of them.
+    void build(const gl::Vector3 *positions, size_t stride, const void *indices, GLenum indexType, size_t indexCount);
+
+    // Nearest hit closer than ray.maxDistance. cull is GL_BACK, GL_FRONT or
+    // GL_NONE, with counter-clockwise triangles facing the ray origin being
+    // front faces as in OpenGL.
+    bool raycast(const Ray &ray, TriangleHit &hit, GLenum cull = GL_NONE) const;
+
+    size_t nodeCount() const { return m_nodes.size(); }
+    size_t triangleCount() const { return m_triangleCount; }
+
+private:
+    struct Node
+    {
+        float minimum[3];
+        GLuint offset;      // Second child of an inner node, packet of a leaf
+        float maximum[3];
+        GLuint count;       // Triangles in a leaf, 0 for inner nodes
+    };
+
+    // Four triangles as structure of arrays. Unused lanes have zero edges,
+    // which no ray can hit.
+    struct TrianglePacket
+    {
+        float v0[3][4];
+        float edge1[3][4];
+        float edge2[3][4];
+        GLuint triangle[4];
+    };
+
+    struct BuildTriangle;
+    struct Traversal;
+
+    GLuint buildNode(std::vector<BuildTriangle> &triangles, size_t first, size_t count, unsigned int depth);
+
+    static float intersectNode(const Node &node, const Traversal &ray, float maxDistance);
+    static bool intersectPacket(const TrianglePacket &packet, const Traversal &ray, TriangleHit &hit);
+
+    std::vector<Node> m_nodes;
+    std::vector<TrianglePacket> m_packets;
+    size_t m_triangleCount;
+};
+
+#endif
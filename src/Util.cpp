@@ -1,12 +1,70 @@
 
 #include "Util.h"
+#include "Bounds.h"
+#include "CookedAssets.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshRegistry.h"
+#include "MeshSimplifier.h"
+#include "ObjLoader.h"
+#include "VertexPacking.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
 #include <fstream>
 #include <iostream>
+#include <map>
 #include <sstream>
 
+#if !_WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "stb_image.h"
 
+namespace
+{
+    // Names of the uniforms in the enum in Util.h, in the same order
+    const char *uniformNames[NUM_UNIFORMS] =
+    {
+        "positionScale",
+        "positionOffset",
+        "screenWidth",
+        "screenHeight",
+        "texPosition",
+        "texDiffuse",
+        "texNormal",
+        "texDiffuseColor",
+        "texSpecularColor",
+        "texShininess"
+    };
+
+    // Members of the FrameData block and where FrameUniforms keeps them
+    struct FrameMember
+    {
+        const char *name;
+        size_t offset;
+    };
+
+    const FrameMember frameMembers[] =
+    {
+        { "projection", offsetof(FrameUniforms, projection) },
+        { "lightPositions[0]", offsetof(FrameUniforms, lightPositions) },
+        { "lightColors[0]", offsetof(FrameUniforms, lightColors) },
+        { "ambientLight", offsetof(FrameUniforms, ambientLight) },
+        { "numLights", offsetof(FrameUniforms, numLights) },
+        { "selectedID", offsetof(FrameUniforms, selectedID) },
+        { "packedVertices", offsetof(FrameUniforms, packedVertices) }
+    };
+
+    std::map<GLuint, std::vector<GLint> > programUniforms;
+}
+
 void fatalError(std::string message)
 {
     if (message != "")
@@ -33,54 +91,172 @@ void checkError(std::string message)
     }
 }
 
-std::string readFile(std::string filename)
+MappedFile::MappedFile()
+    : m_data(0), m_size(0), m_open(false), m_mapped(false)
+{
+}
+
+MappedFile::MappedFile(const std::string &filename)
+    : m_data(0), m_size(0), m_open(false), m_mapped(false)
+{
+    open(filename);
+}
+
+MappedFile::MappedFile(MappedFile &&other)
+    : m_data(0), m_size(0), m_open(false), m_mapped(false)
+{
+    *this = std::move(other);
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other)
+{
+    if (this != &other)
+    {
+        close();
+        m_buffer.swap(other.m_buffer);
+        m_data = other.m_data;
+        m_size = other.m_size;
+        m_open = other.m_open;
+        m_mapped = other.m_mapped;
+        other.m_data = 0;
+        other.m_size = 0;
+        other.m_open = false;
+        other.m_mapped = false;
+    }
+    return *this;
+}
+
+bool MappedFile::open(const std::string &filename)
 {
-    std::ifstream in;
-    std::string str;
+    close();
 
-    in.open(filename, std::ios::in | std::ios::binary);
+#if _WIN32
+    std::ifstream in(filename, std::ios::in | std::ios::binary);
     if (!in.is_open())
-        fatalError("Could not open file '" + filename + "'");
+        return false;
     in.seekg(0, std::ios::end);
-    str.resize(in.tellg());
+    m_buffer.resize((size_t) in.tellg());
     in.seekg(0, std::ios::beg);
-    in.read(&str[0], str.size());
-    in.close();
+    in.read(m_buffer.data(), m_buffer.size());
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
 
-    return str;
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    size_t size = (size_t) info.st_size;
+    if (size > 0)
+    {
+        void *mapping = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED)
+        {
+            madvise(mapping, size, MADV_SEQUENTIAL);
+            m_data = (const char *) mapping;
+            m_size = size;
+            m_mapped = true;
+        }
+        else
+        {
+            m_buffer.resize(size);
+            size_t total = 0;
+            while (total < size)
+            {
+                ssize_t count = read(fd, m_buffer.data() + total, size - total);
+                if (count <= 0)
+                    break;
+                total += count;
+            }
+            m_buffer.resize(total);
+        }
+    }
+    ::close(fd);
+#endif
+
+    if (!m_mapped)
+    {
+        m_data = m_buffer.data();
+        m_size = m_buffer.size();
+    }
+    m_open = true;
+    return true;
 }
 
-GLuint loadProgram(std::string vFile, std::string fFile)
+void MappedFile::close()
+{
+#if !_WIN32
+    if (m_mapped)
+        munmap((void *) m_data, m_size);
+#endif
+    std::vector<char>().swap(m_buffer);
+    m_data = 0;
+    m_size = 0;
+    m_open = false;
+    m_mapped = false;
+}
+
+void MappedFile::discard(const char *begin, const char *end)
+{
+#if !_WIN32
+    if (!m_mapped)
+        return;
+
+    uintptr_t pageSize = (uintptr_t) sysconf(_SC_PAGESIZE);
+    uintptr_t first = ((uintptr_t) std::max(begin, m_data) + pageSize - 1) / pageSize * pageSize;
+    uintptr_t last = (uintptr_t) std::min(end, m_data + m_size) / pageSize * pageSize;
+    if (first < last)
+        madvise((void *) first, last - first, MADV_DONTNEED);
+#endif
+}
+
+std::string readFile(std::string filename)
 {
-    GLuint vShader = glCreateShader(GL_VERTEX_SHADER);
-    std::string vSource = readFile(vFile);
-    const char *vSourceP = vSource.c_str();
-    glShaderSource(vShader, 1, &vSourceP, 0);
-    glCompileShader(vShader);
+    MappedFile file(filename);
+    if (!file.isOpen())
+        fatalError("Could not open file '" + filename + "'");
+    return std::string(file.begin(), file.end());
+}
+
+GLuint compileShader(GLenum type, const std::string &filename)
+{
+    MappedFile source(filename);
+    if (!source.isOpen())
+        fatalError("Could not open file '" + filename + "'");
+
+    GLuint shader = glCreateShader(type);
+    const char *sourceP = source.data();
+    GLint length = (GLint) source.size();
+    glShaderSource(shader, 1, &sourceP, &length);
+    glCompileShader(shader);
 
     GLint success;
-    glGetShaderiv(vShader, GL_COMPILE_STATUS, &success);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
     if (!success)
     {
         char infoLog[1024];
-        glGetShaderInfoLog(vShader, 1024, 0, infoLog);
+        glGetShaderInfoLog(shader, 1024, 0, infoLog);
         fatalError(infoLog);
     }
 
-    GLuint fShader = glCreateShader(GL_FRAGMENT_SHADER);
-    std::string fSource = readFile(fFile);
-    const char *fSourceP = fSource.c_str();
-    glShaderSource(fShader, 1, &fSourceP, 0);
-    glCompileShader(fShader);
+    return shader;
+}
 
-    glGetShaderiv(fShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        char infoLog[1024];
-        glGetShaderInfoLog(fShader, 1024, 0, infoLog);
-        fatalError(infoLog);
-    }
+GLuint loadProgram(std::string vFile, std::string fFile)
+{
+    GLuint vShader = compileShader(GL_VERTEX_SHADER, vFile);
+    GLuint fShader = compileShader(GL_FRAGMENT_SHADER, fFile);
 
+    GLint success;
     GLuint program = glCreateProgram();
     glAttachShader(program, vShader);
     glAttachShader(program, fShader);
@@ -94,102 +270,281 @@ GLuint loadProgram(std::string vFile, std::string fFile)
         fatalError(infoLog);
     }
 
+    GLuint frameBlock = glGetUniformBlockIndex(program, "FrameData");
+    if (frameBlock != GL_INVALID_INDEX)
+    {
+        // Implementations may round the block size up differently, so only
+        // a block larger than the upload or a member that moved is an error
+        GLint size;
+        glGetActiveUniformBlockiv(program, frameBlock, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+        if (size > (GLint) sizeof(FrameUniforms))
+        {
+            std::ostringstream message;
+            message << "FrameData block in '" << vFile << "' has " << size << " bytes, more than " << sizeof(FrameUniforms);
+            fatalError(message.str());
+        }
+
+        for (const FrameMember &member : frameMembers)
+        {
+            GLuint index;
+            glGetUniformIndices(program, 1, &member.name, &index);
+            if (index == GL_INVALID_INDEX)
+                continue;
+
+            GLint offset;
+            glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_OFFSET, &offset);
+            if (offset != (GLint) member.offset)
+            {
+                std::ostringstream message;
+                message << "FrameData member '" << member.name << "' in '" << vFile << "' is at offset " << offset
+                        << " instead of " << member.offset;
+                fatalError(message.str());
+            }
+        }
+        glUniformBlockBinding(program, frameBlock, FRAME_UNIFORM_BINDING);
+    }
+
+    std::vector<GLint> &locations = programUniforms[program];
+    locations.resize(NUM_UNIFORMS);
+    for (unsigned int i = 0; i < NUM_UNIFORMS; ++i)
+        locations[i] = glGetUniformLocation(program, uniformNames[i]);
+
     return program;
 }
 
-std::vector<Vertex> LoadOBJ(const std::string &filename)
+const GLint *uniformLocations(GLuint program)
+{
+    std::map<GLuint, std::vector<GLint> >::const_iterator found = programUniforms.find(program);
+    if (found == programUniforms.end())
+    {
+        std::ostringstream message;
+        message << "Program " << program << " was not loaded with loadProgram";
+        fatalError(message.str());
+    }
+    return &found->second[0];
+}
+
+void loadModel(MeshHandle mesh, const std::string &filename)
 {
-    std::vector<Vertex> vertices;
+    CachedMesh cached;
+    if (readMeshCache(filename, cached))
+    {
+        if (cpuPicking)
+            buildTriangleBvh(meshes[mesh].triangles, cached);
+        uploadModel(mesh, cached);
+    }
+    else if (streamingBudget > 0)
+        streamModel(mesh, filename);
+    else
+    {
+        MeshData data = LoadIndexedOBJ(filename);
+        optimizeMesh(data, filename);
+        generateLods(data, filename);
+        writeMeshCache(filename, data);
+        if (cpuPicking)
+            buildTriangleBvh(meshes[mesh].triangles, data);
+        uploadModel(mesh, data);
+    }
+}
 
-    std::ifstream in(filename, std::ios::in);
-    if (in)
+void uploadModel(MeshHandle mesh, const MeshData &data)
+{
+    MeshLod full = { 0, (GLuint) data.indices.size(), 0 };
+    const MeshLod *lods = data.lods.empty() ? &full : &data.lods[0];
+    unsigned int lodCount = data.lods.empty() ? 1 : (unsigned int) data.lods.size();
+
+    GLenum type = indexType(data.vertices.size());
+    if (type == GL_UNSIGNED_SHORT)
     {
-        std::vector<gl::Vector3> positions;
-        std::vector<gl::Vector2> textureCoords;
-        std::vector<gl::Vector3> normals;
+        std::vector<GLushort> indices(data.indices.begin(), data.indices.end());
+        uploadMesh(mesh, &data.vertices[0], data.vertices.size(), &indices[0], indices.size(), type, lods, lodCount);
+    }
+    else
+        uploadMesh(mesh, &data.vertices[0], data.vertices.size(), &data.indices[0], data.indices.size(), type, lods, lodCount);
+}
+
+void uploadModel(MeshHandle mesh, const CachedMesh &cached)
+{
+    uploadMesh(mesh, cached.vertices, cached.header->vertexCount, cached.indices, cached.header->indexCount, cached.header->indexType,
+               cached.header->lods, cached.header->lodCount);
+}
+
+void uploadMesh(MeshHandle mesh, const Vertex *vertices, size_t vertexCount, const void *indices, size_t indexCount, GLenum type,
+                const MeshLod *lods, unsigned int lodCount)
+{
+    MeshEntry &entry = meshes[mesh];
+    entry.lodCount = std::min<unsigned int>(lodCount, MAX_MESH_LODS);
+    std::copy(lods, lods + entry.lodCount, entry.lods);
+    entry.bounds = computeBounds(&vertices[0].position, vertexCount, sizeof(Vertex));
+
+    if (packedVertices)
+    {
+        PackedMesh packed = packVertices(vertices, vertexCount);
+        entry.positionScale = packed.positionScale;
+        entry.positionOffset = packed.positionOffset;
+        meshes.upload(mesh, &packed.vertices[0], vertexCount, indices, indexCount, type);
+
+        std::ostringstream message;
+        message << "Packed Mesh '" << entry.filename << "' vertex bytes: " << sizeof(Vertex) * vertexCount
+                << " -> " << sizeof(PackedVertex) * vertexCount << " (saved "
+                << (sizeof(Vertex) - sizeof(PackedVertex)) * vertexCount << ") max error position: "
+                << packed.maxPositionError << " texture coordinate: " << packed.maxTextureCoordError
+                << " normal: " << packed.maxNormalError << std::endl;
+        std::cout << message.str();
+    }
+    else
+    {
+        entry.positionScale = gl::Vector3(1, 1, 1);
+        entry.positionOffset = gl::Vector3(0, 0, 0);
+        meshes.upload(mesh, vertices, vertexCount, indices, indexCount, type);
+    }
+}
+
+void buildTriangleBvh(TriangleBvh &bvh, const MeshData &data)
+{
+    if (data.vertices.empty())
+        return;
+
+    MeshLod full = data.lods.empty() ? MeshLod{ 0, (GLuint) data.indices.size(), 0 } : data.lods[0];
+    bvh.build(&data.vertices[0].position, sizeof(Vertex), &data.indices[full.indexOffset], GL_UNSIGNED_INT, full.indexCount);
+}
+
+void buildTriangleBvh(TriangleBvh &bvh, const CachedMesh &cached)
+{
+    const MeshCacheHeader &header = *cached.header;
+    const MeshLod &full = header.lods[0];
+    const char *indices = (const char *) cached.indices + full.indexOffset * indexSize(header.indexType);
+    bvh.build(&cached.vertices[0].position, sizeof(Vertex), indices, header.indexType, full.indexCount);
+}
+
+void streamModel(MeshHandle mesh, const std::string &filename)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    ObjStreamReader reader;
+    if (!reader.open(filename, streamingBudget))
+        fatalError("Could not open file '" + filename + "'");
+
+    const std::vector<gl::Vector3> &positions = reader.positions();
+    Bounds bounds = computeBounds(positions.data(), positions.size());
+
+    // The staging buffer, and its packed copy, fill the budget
+    size_t vertexSize = packedVertices ? sizeof(PackedVertex) : sizeof(Vertex);
+    size_t stagingBytes = packedVertices ? sizeof(Vertex) + sizeof(PackedVertex) : sizeof(Vertex);
+    std::vector<Vertex> staging(std::max<size_t>(streamingBudget / stagingBytes, 3));
 
-        std::string line;
-        while (std::getline(in, line))
+    MeshEntry &entry = meshes[mesh];
+    entry.positionScale = gl::Vector3(1, 1, 1);
+    entry.positionOffset = gl::Vector3(0, 0, 0);
+
+    // The ray cast tree indexes the reader's positions, so only the position
+    // index of each corner has to be kept
+    std::vector<GLuint> corners(cpuPicking ? reader.maxVertexCount() : 0);
+
+    size_t offset = meshes.reserveVertices(mesh, reader.maxVertexCount());
+    size_t total = 0;
+    size_t flushes = 0;
+    for (size_t count; (count = reader.read(&staging[0], staging.size(), cpuPicking ? corners.data() + total : 0)) > 0;
+         total += count, ++flushes)
+    {
+        if (packedVertices)
         {
-            std::stringstream lineIn(line);
-            std::string token;
-            lineIn >> token;
-            if (token == "v")
-            {
-                gl::Vector3 v;
-                lineIn >> v[0] >> v[1] >> v[2];
-                positions.push_back(v);
-            }
-            else if (token == "vt")
-            {
-                gl::Vector2 vt;
-                lineIn >> vt[0] >> vt[1];
-                textureCoords.push_back(vt);
-            }
-            else if (token == "vn")
-            {
-                gl::Vector3 vn;
-                lineIn >> vn[0] >> vn[1] >> vn[2];
-                normals.push_back(vn);
-            }
-            else if (token == "f")
-            {
-                for (int i = 0; i < 3; ++i)
-                {
-                    unsigned int v, vt, vn;
-                    char c;
-                    lineIn >> v >> c >> vt >> c >> vn;
-                    if (v <= positions.size() && vt <= textureCoords.size() && vn <= normals.size())
-                    {
-                        Vertex vertex;
-                        vertex.position = positions[v - 1];
-                        vertex.textureCoord = textureCoords[vt - 1];
-                        vertex.normal = normals[vn - 1];
-                        vertices.push_back(vertex);
-                    }
-                }
-            }
+            PackedMesh packed = packVertices(&staging[0], count, bounds.minimum, bounds.maximum);
+            entry.positionScale = packed.positionScale;
+            entry.positionOffset = packed.positionOffset;
+            glBufferSubData(GL_ARRAY_BUFFER, offset + vertexSize * total, vertexSize * count, &packed.vertices[0]);
         }
+        else
+            glBufferSubData(GL_ARRAY_BUFFER, offset + vertexSize * total, vertexSize * count, &staging[0]);
     }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    meshes.trimVertices(mesh, total);
 
-    if (vertices.size() == 0)
+    if (total == 0)
         fatalError("Failed to load model '" + filename + "'");
-    std::cout << "Loaded Model '" << filename << "' vertices: " << vertices.size() << std::endl;
 
-    return vertices;
+    MeshLod full = { 0, (GLuint) total, 0 };
+    entry.lods[0] = full;
+    entry.lodCount = 1;
+    entry.bounds = bounds;
+    if (cpuPicking)
+    {
+        corners.resize(total);
+        entry.triangles.build(reader.positions(), corners);
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::ostringstream message;
+    message << "Streamed Model '" << filename << "' vertices: " << total << " flushes: " << flushes
+            << " staging: " << staging.size() * stagingBytes << " bytes lines: " << reader.lines()
+            << " time: " << seconds * 1000 << " ms peak RSS: " << peakResidentBytes() / (1 << 20)
+            << " MB" << std::endl;
+    std::cout << message.str();
 }
 
-void loadModel(unsigned int name, const std::string &filename)
+size_t peakResidentBytes()
 {
-    auto vertices = LoadOBJ(filename);
-    vao_count[name] = vertices.size();
-    vao_mode[name] = GL_TRIANGLES;
-    glBindVertexArray(vao[name]);
-    glBindBuffer(GL_ARRAY_BUFFER, vao_buffer[name]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vao_count[name], &vertices[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), OFFSET(Vertex, position));
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), OFFSET(Vertex, textureCoord));
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), OFFSET(Vertex, normal));
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-    glBindVertexArray(0);
+#if _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return (size_t) usage.ru_maxrss;
+#else
+    return (size_t) usage.ru_maxrss * 1024;
+#endif
+#endif
 }
 
 void loadTexture(unsigned int name, const std::string &filename)
 {
-    int width, height, comp;
-    stbi_uc *pixels = stbi_load(filename.c_str(), &width, &height, &comp, 4);
-    if (pixels == NULL)
+    TextureData texture = decodeTexture(filename);
+    uploadTexture(name, texture);
+    freeTexture(texture);
+}
+
+TextureData decodeTexture(const std::string &filename)
+{
+    TextureData texture;
+    texture.pixels = stbi_load(filename.c_str(), &texture.width, &texture.height, &texture.components, 4);
+    if (texture.pixels == NULL)
         fatalError("Failed to load texture '" + filename + "'");
-    std::cout << "Loaded Texture '" << filename << "' width: " << width << " height: " << height << " components: " << comp << std::endl;
+
+    std::ostringstream message;
+    message << "Loaded Texture '" << filename << "' width: " << texture.width << " height: " << texture.height << " components: " << texture.components << std::endl;
+    std::cout << message.str();
+
+    return texture;
+}
+
+void uploadTexture(unsigned int name, const TextureData &texture)
+{
     glBindTexture(GL_TEXTURE_2D, tex[name]);
     checkError("glew 0");
-    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, width, height);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, texture.width, texture.height);
     checkError("glew 1");
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texture.width, texture.height, GL_RGBA, GL_UNSIGNED_BYTE, texture.pixels);
     checkError("glew 2");
-    stbi_image_free(pixels);
     glBindTexture(GL_TEXTURE_2D, 0);
     checkError("glew 3");
 }
+
+void uploadTexture(unsigned int name, const CookedTexture &texture)
+{
+    glBindTexture(GL_TEXTURE_2D, tex[name]);
+    glTexStorage2D(GL_TEXTURE_2D, texture.levelCount, GL_RGBA32F, texture.levelWidth[0], texture.levelHeight[0]);
+    for (unsigned int level = 0; level < texture.levelCount; ++level)
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, texture.levelWidth[level], texture.levelHeight[level], GL_RGBA, GL_UNSIGNED_BYTE, texture.levels[level]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture.levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    checkError("Upload Cooked Texture");
+}
+
+void freeTexture(TextureData &texture)
+{
+    stbi_image_free(texture.pixels);
+    texture.pixels = NULL;
+}
@@ -24,6 +24,33 @@ struct Vertex
     gl::Vector3 normal;
 };
 
+struct TextureData
+{
+    int width;
+    int height;
+    int components;
+    unsigned char *pixels;
+};
+
+// Range of a mesh's index buffer drawn for one level of detail. error is
+// the simplification error of the level in object-space units.
+struct MeshLod
+{
+    GLuint indexOffset;
+    GLuint indexCount;
+    float error;
+};
+
+enum { MAX_MESH_LODS = 4 };
+
+// Index of a mesh in the MeshRegistry
+typedef GLuint MeshHandle;
+
+struct MeshData;
+struct CachedMesh;
+struct CookedTexture;
+class TriangleBvh;
+
 struct Entity
 {
     gl::Vector3 translation;
@@ -34,29 +61,52 @@ struct Entity
     gl::Vector3 specularColor;
     float shininess;
 
-    GLuint mesh;
+    MeshHandle mesh;
     GLuint texture;
     GLuint objectID;
     GLenum cull;
 };
 
-#define OFFSET(Type, member) \
-    (GLvoid *) (&((Type *) 0)->member)
-
-enum
+// Read-only view of a whole file. The file is memory-mapped where the
+// platform allows it and read into a private buffer otherwise.
+class MappedFile
 {
-    CUBE_MESH,
-    SKELETON_MESH,
-    TABLE_MESH,
-    FLOOR_MESH,
-    WALL_MESH,
-    CHAIR_MESH,
-    SHELVES_MESH,
-    CHEST_MESH,
-    SPHERE_MESH,
-    NUM_VERTEX_OBJECTS
+public:
+    MappedFile();
+    explicit MappedFile(const std::string &filename);
+    MappedFile(MappedFile &&other);
+    ~MappedFile();
+
+    MappedFile &operator=(MappedFile &&other);
+
+    bool open(const std::string &filename);
+    void close();
+
+    // Lets the OS drop the mapped pages between begin and end. They are
+    // read back from the file if touched again.
+    void discard(const char *begin, const char *end);
+
+    bool isOpen() const { return m_open; }
+    bool isMapped() const { return m_mapped; }
+    const char *data() const { return m_data; }
+    size_t size() const { return m_size; }
+    const char *begin() const { return m_data; }
+    const char *end() const { return m_data + m_size; }
+
+private:
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+
+    const char *m_data;
+    size_t m_size;
+    bool m_open;
+    bool m_mapped;
+    std::vector<char> m_buffer;
 };
 
+#define OFFSET(Type, member) \
+    (GLvoid *) (&((Type *) 0)->member)
+
 enum
 {
     SMILE_TEXTURE,
@@ -70,24 +120,87 @@ enum
     SPHERE_TEXTURE,
     PICK_COLOR_TEXTURE,
     PICK_DEPTH_TEXTURE,
+    OVERDRAW_COUNT_TEXTURE,
+    OVERDRAW_DEPTH_TEXTURE,
     NUM_TEXTURES
 };
 
-enum { PICK_FRAMEBUFFER, NUM_FRAMEBUFFERS };
+enum { PICK_FRAMEBUFFER, OVERDRAW_FRAMEBUFFER, NUM_FRAMEBUFFERS };
+
+// Uniforms looked up by name once when loadProgram links a program
+enum
+{
+    POSITION_SCALE_UNIFORM,
+    POSITION_OFFSET_UNIFORM,
+    SCREEN_WIDTH_UNIFORM,
+    SCREEN_HEIGHT_UNIFORM,
+    TEX_POSITION_UNIFORM,
+    TEX_DIFFUSE_UNIFORM,
+    TEX_NORMAL_UNIFORM,
+    TEX_DIFFUSE_COLOR_UNIFORM,
+    TEX_SPECULAR_COLOR_UNIFORM,
+    TEX_SHININESS_UNIFORM,
+    NUM_UNIFORMS
+};
+
+enum { FRAME_UNIFORM_BINDING = 0, MAX_LIGHTS = 10 };
+
+// Contents of the std140 FrameData uniform block the shaders share, which
+// loadProgram attaches to FRAME_UNIFORM_BINDING
+struct FrameUniforms
+{
+    float projection[16];
+    float lightPositions[MAX_LIGHTS][4];    // View space
+    float lightColors[MAX_LIGHTS][4];       // Array elements take 16 bytes
+    float ambientLight[3];
+    GLuint numLights;
+    GLuint selectedID;
+    GLuint packedVertices;
+    GLuint padding[2];                      // Blocks round up to 16 bytes
+};
 
-extern GLuint vao[NUM_VERTEX_OBJECTS];
-extern GLuint vao_mode[NUM_VERTEX_OBJECTS];
-extern GLuint vao_count[NUM_VERTEX_OBJECTS];
-extern GLuint vao_buffer[NUM_VERTEX_OBJECTS];
 extern GLuint tex[NUM_TEXTURES];
 extern GLuint fbo[NUM_FRAMEBUFFERS]; 
 
+// Upload meshes with PackedVertex instead of Vertex
+extern bool packedVertices;
+
+// When non-zero, OBJ models without a cooked or cached copy are streamed to
+// the GPU through a staging buffer of this many bytes instead of being
+// loaded whole. Streamed meshes are drawn without indices or LODs.
+extern size_t streamingBudget;
+
+// Pick by casting a ray on the CPU instead of rendering the pick framebuffer.
+// Meshes only get the triangle trees it needs when this is set.
+extern bool cpuPicking;
+
 void fatalError(std::string message = "");
 void checkError(std::string message = "");
 std::string readFile(std::string filename);
+GLuint compileShader(GLenum type, const std::string &filename);
 GLuint loadProgram(std::string vFile, std::string fFile);
-std::vector<Vertex> LoadOBJ(const std::string &filename);
-void loadModel(unsigned int name, const std::string &filename);
+
+// Locations of the uniforms above in a program from loadProgram, indexed by
+// the enum, with -1 for uniforms the program doesn't use
+const GLint *uniformLocations(GLuint program);
+void loadModel(MeshHandle mesh, const std::string &filename);
+void uploadModel(MeshHandle mesh, const MeshData &data);
+void uploadModel(MeshHandle mesh, const CachedMesh &cached);
+void uploadMesh(MeshHandle mesh, const Vertex *vertices, size_t vertexCount, const void *indices, size_t indexCount, GLenum type,
+                const MeshLod *lods, unsigned int lodCount);
+void streamModel(MeshHandle mesh, const std::string &filename);
+
+// Level 0 triangle tree for CPU picking. Slow for large meshes, so it is
+// built where the mesh is decoded rather than on the GL thread.
+void buildTriangleBvh(TriangleBvh &bvh, const MeshData &data);
+void buildTriangleBvh(TriangleBvh &bvh, const CachedMesh &cached);
 void loadTexture(unsigned int name, const std::string &filename);
+TextureData decodeTexture(const std::string &filename);
+void uploadTexture(unsigned int name, const TextureData &texture);
+void uploadTexture(unsigned int name, const CookedTexture &texture);
+void freeTexture(TextureData &texture);
+
+// Largest resident set size of the process so far, or 0 where unsupported
+size_t peakResidentBytes();
 
 #endif
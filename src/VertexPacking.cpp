@@ -0,0 +1,201 @@
+
+#include "VertexPacking.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+    const float SHORT_SCALE = 32767.0f;
+
+    GLshort quantize(float value)
+    {
+        value = std::max(-1.0f, std::min(1.0f, value));
+        return (GLshort) lrintf(value * SHORT_SCALE);
+    }
+
+    float signNotZero(float value)
+    {
+        return value >= 0 ? 1.0f : -1.0f;
+    }
+}
+
+GLushort floatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7fffffff;
+
+    if (magnitude >= 0x7f800000)
+        return (GLushort) (sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0));
+    if (magnitude >= 0x477ff000)
+        return (GLushort) (sign | 0x7c00);
+
+    if (magnitude < 0x38800000)
+    {
+        if (magnitude < 0x33000000)
+            return (GLushort) sign;
+
+        uint32_t exponent = magnitude >> 23;
+        uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+        uint32_t shift = 126 - exponent;
+        uint32_t result = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (result & 1)))
+            ++result;
+        return (GLushort) (sign | result);
+    }
+
+    uint32_t result = (magnitude - 0x38000000) >> 13;
+    uint32_t remainder = magnitude & 0x1fff;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (result & 1)))
+        ++result;
+    return (GLushort) (sign | result);
+}
+
+float halfToFloat(GLushort value)
+{
+    uint32_t sign = (uint32_t) (value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+
+    float result;
+    if (exponent == 0)
+        result = ldexpf((float) mantissa, -24);
+    else if (exponent == 31)
+        result = mantissa ? NAN : INFINITY;
+    else
+        result = ldexpf((float) (mantissa | 0x400), (int) exponent - 25);
+
+    return sign ? -result : result;
+}
+
+void encodeOctahedral(const gl::Vector3 &normal, GLshort out[2])
+{
+    float length = std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+    if (length == 0)
+    {
+        out[0] = 0;
+        out[1] = 0;
+        return;
+    }
+
+    float x = normal[0] / length;
+    float y = normal[1] / length;
+    if (normal[2] < 0)
+    {
+        float foldedX = (1 - std::fabs(y)) * signNotZero(x);
+        float foldedY = (1 - std::fabs(x)) * signNotZero(y);
+        x = foldedX;
+        y = foldedY;
+    }
+
+    out[0] = quantize(x);
+    out[1] = quantize(y);
+}
+
+gl::Vector3 decodeOctahedral(const GLshort in[2])
+{
+    float x = in[0] / SHORT_SCALE;
+    float y = in[1] / SHORT_SCALE;
+    float z = 1 - std::fabs(x) - std::fabs(y);
+    if (z < 0)
+    {
+        float foldedX = (1 - std::fabs(y)) * signNotZero(x);
+        float foldedY = (1 - std::fabs(x)) * signNotZero(y);
+        x = foldedX;
+        y = foldedY;
+    }
+
+    gl::Vector3 normal(x, y, z);
+    float length = normal.length();
+    return length > 0 ? normal / length : normal;
+}
+
+PackedMesh packVertices(const Vertex *vertices, size_t count)
+{
+    gl::Vector3 minimum = count ? vertices[0].position : gl::Vector3();
+    gl::Vector3 maximum = minimum;
+    for (size_t i = 0; i < count; ++i)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            minimum[c] = std::min(minimum[c], vertices[i].position[c]);
+            maximum[c] = std::max(maximum[c], vertices[i].position[c]);
+        }
+    }
+    return packVertices(vertices, count, minimum, maximum);
+}
+
+PackedMesh packVertices(const Vertex *vertices, size_t count, const gl::Vector3 &minimum, const gl::Vector3 &maximum)
+{
+    PackedMesh mesh;
+    mesh.maxPositionError = 0;
+    mesh.maxTextureCoordError = 0;
+    mesh.maxNormalError = 0;
+
+    float extent = 0;
+    for (int c = 0; c < 3; ++c)
+    {
+        float halfExtent = (maximum[c] - minimum[c]) / 2;
+        mesh.positionOffset[c] = minimum[c] + halfExtent;
+        mesh.positionScale[c] = halfExtent / SHORT_SCALE;
+        extent = std::max(extent, maximum[c] - minimum[c]);
+    }
+
+    mesh.vertices.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const Vertex &vertex = vertices[i];
+        PackedVertex &packed = mesh.vertices[i];
+
+        for (int c = 0; c < 3; ++c)
+        {
+            float scale = mesh.positionScale[c];
+            float relative = scale > 0 ? (vertex.position[c] - mesh.positionOffset[c]) / (scale * SHORT_SCALE) : 0;
+            packed.position[c] = quantize(relative);
+
+            float decoded = packed.position[c] * scale + mesh.positionOffset[c];
+            mesh.maxPositionError = std::max(mesh.maxPositionError, std::fabs(decoded - vertex.position[c]));
+        }
+        packed.position[3] = 1;
+
+        for (int c = 0; c < 2; ++c)
+        {
+            packed.textureCoord[c] = floatToHalf(vertex.textureCoord[c]);
+
+            float error = std::fabs(halfToFloat(packed.textureCoord[c]) - vertex.textureCoord[c]);
+            error /= std::max(1.0f, std::fabs(vertex.textureCoord[c]));
+            mesh.maxTextureCoordError = std::max(mesh.maxTextureCoordError, error);
+        }
+
+        encodeOctahedral(vertex.normal, packed.normal);
+        float length = vertex.normal.length();
+        if (length > 0)
+        {
+            gl::Vector3 error = decodeOctahedral(packed.normal) - vertex.normal / length;
+            mesh.maxNormalError = std::max(mesh.maxNormalError, error.length());
+        }
+    }
+
+    float positionError = extent > 0 ? mesh.maxPositionError / extent : 0;
+    if (positionError > PACKED_POSITION_TOLERANCE ||
+        mesh.maxTextureCoordError > PACKED_TEXTURE_COORD_TOLERANCE ||
+        mesh.maxNormalError > PACKED_NORMAL_TOLERANCE)
+    {
+        std::ostringstream message;
+        message << "Packed vertex decode error above tolerance: position " << positionError
+                << " texture coordinate " << mesh.maxTextureCoordError
+                << " normal " << mesh.maxNormalError << std::endl;
+        std::cerr << message.str();
+    }
+
+    return mesh;
+}
@@ -0,0 +1,51 @@
+
+#ifndef VERTEX_PACKING_H
+#define VERTEX_PACKING_H
+
+#include <vector>
+
+#include "Util.h"
+
+// 16-byte alternative to Vertex. Positions are 16-bit integers relative to
+// the mesh bounds, texture coordinates are half floats and normals are
+// octahedral-encoded into two 16-bit integers. The shaders rebuild the
+// position as position * positionScale + positionOffset and the normal as
+// the octahedral decode of normal.xy / 32767.
+struct PackedVertex
+{
+    GLshort position[4];
+    GLushort textureCoord[2];
+    GLshort normal[2];
+};
+
+struct PackedMesh
+{
+    std::vector<PackedVertex> vertices;
+    gl::Vector3 positionScale;
+    gl::Vector3 positionOffset;
+
+    // Largest difference between a decoded attribute and its source value
+    float maxPositionError;
+    float maxTextureCoordError;
+    float maxNormalError;
+};
+
+// Decode tolerances checked by packVertices. Position error is relative to
+// the largest extent of the mesh; texture coordinate error is relative to
+// max(1, |uv|).
+const float PACKED_POSITION_TOLERANCE = 1e-4f;
+const float PACKED_TEXTURE_COORD_TOLERANCE = 1e-3f;
+const float PACKED_NORMAL_TOLERANCE = 1e-3f;
+
+PackedMesh packVertices(const Vertex *vertices, size_t count);
+
+// Packs relative to the given bounds instead of the bounds of vertices, so
+// that separately packed parts of one mesh share a position encoding.
+PackedMesh packVertices(const Vertex *vertices, size_t count, const gl::Vector3 &minimum, const gl::Vector3 &maximum);
+
+GLushort floatToHalf(float value);
+float halfToFloat(GLushort value);
+void encodeOctahedral(const gl::Vector3 &normal, GLshort out[2]);
+gl::Vector3 decodeOctahedral(const GLshort in[2]);
+
+#endif
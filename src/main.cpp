@@ -1,24 +1,43 @@
 
 #include "Util.h"
+#include "AssetLoader.h"
+#include "EntityBvh.h"
+#include "GpuTimer.h"
+#include "MeshRegistry.h"
+#include "Picking.h"
+#include "RenderQueue.h"
 #include "gbuffer.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
 #include <iostream>
+#include <map>
 
 int screenWidth = 1024;
 int screenHeight = 768;
 
-GLuint vao[NUM_VERTEX_OBJECTS];
-GLuint vao_mode[NUM_VERTEX_OBJECTS];
-GLuint vao_count[NUM_VERTEX_OBJECTS];
-GLuint vao_buffer[NUM_VERTEX_OBJECTS];
+const float FIELD_OF_VIEW = 60;
+
+// Coarsest level of detail is chosen whose error projects to at most this
+// many pixels
+const float LOD_PIXEL_ERROR = 1.0f;
+
+MeshRegistry meshes;
+MeshHandle cubeMesh;
 GLuint tex[NUM_TEXTURES];
 GLuint fbo[NUM_FRAMEBUFFERS];
 
+bool packedVertices = false;
+size_t streamingBudget = 0;
+
 GLuint drawProgram;
 GLuint pickProgram;
 GLuint geometryProgram;
 GLuint renderPassProgram;
+GLuint overdrawProgram;
+GLuint overdrawViewProgram;
+GLuint depthProgram;
 
 GBuffer gbuffer;
 
@@ -26,6 +45,7 @@ gl::Matrix4Stack modelview;
 gl::Matrix4Stack projection;
 
 std::vector<Entity> entities;
+EntityBvh entityBvh;
 
 const unsigned int NUM_LIGHTS = 4;
 
@@ -69,6 +89,59 @@ gl::Vector3 up;
 
 bool hidecursor = true;
 
+bool cpuPicking = false;
+
+// Draw the geometry, pick and overdraw passes nearest first instead of in
+// the order with the fewest state changes
+bool frontToBack = true;
+
+// Lay down depth with a position-only pass first, then shade with an equal
+// depth test so each pixel is shaded once. Chosen separately for the
+// forward display and for the passes of the other displays.
+bool forwardDepthPrepass = false;
+bool deferredDepthPrepass = false;
+
+// Copies of the furniture added behind the back wall to stress the renderer
+unsigned int stressCopies = 0;
+const float STRESS_SPACING = 2;
+
+// Objects listed one per line in the frame stats, unless there are more
+const size_t MAX_LISTED_OBJECTS = 64;
+
+// A GPU pick renders a few pixels around the cursor on the next frame and
+// copies the ID into pickBuffer. The selection changes once the fence
+// signals, so reading it back never waits for the GPU.
+struct PickRequest
+{
+    bool requested;
+    int x;
+    int y;
+    GLsync fence;
+};
+
+const int PICK_REGION = 5;
+PickRequest pickRequest = { false, 0, 0, 0 };
+GLuint pickBuffer;
+
+// --pick-check compares the pick pass with pickEntity at every
+// PICK_CHECK_STEP pixels of each of these views, then exits
+struct PickCheckView
+{
+    float xRot;
+    float yRot;
+    float zoom;
+};
+
+const PickCheckView PICK_CHECK_VIEWS[] =
+{
+    { 45, 20, 5 }, { 135, 40, 8 }, { 250, 10, 3 }, { 300, 60, 20 }, { 10, 5, 40 }
+};
+const int PICK_CHECK_STEP = 7;
+bool pickCheck = false;
+
+// Holds a FrameUniforms, rewritten by each call to draw()
+GLuint frameUniformBuffer;
+
 unsigned int selected = 0;
 unsigned int selectedIndex = 0;
 
@@ -81,7 +154,64 @@ enum Mode
 
 Mode editMode = TRANSLATE;
 
-Entity CreateEntity(GLuint mesh, GLuint texture, GLuint objectID)
+// Entities drawn and skipped by frustum culling in one call to draw()
+struct PassStats
+{
+    GLuint program;
+    unsigned int drawn;
+    unsigned int culled;
+
+    // GPU time of the main pass and of its depth pre-pass, from a few
+    // frames ago; negative when not measured
+    double milliseconds;
+    double prepassMilliseconds;
+};
+
+struct FrameStats
+{
+    unsigned int draws;
+    unsigned int instances;
+    unsigned int triangles;
+    unsigned int lodDraws[MAX_MESH_LODS];
+    unsigned int vertexArrayBinds;
+
+    // Made by draw(), the render queue and the lighting pass of display3()
+    unsigned int glCalls;
+
+    // Program, cull face and texture changes the render queue asked for,
+    // and how many GL calls the state cache actually made for them
+    unsigned int stateRequests;
+    unsigned int stateChanges;
+
+    // Fragments that passed the depth test and pixels covered, counted by
+    // the overdraw display
+    unsigned int overdrawFragments;
+    unsigned int overdrawPixels;
+
+    std::vector<PassStats> passes;
+
+    // GPU time of the whole frame, from a few frames ago
+    double gpuMilliseconds;
+};
+
+FrameStats frameStats;
+
+// Level drawn for each entity by the last pass that drew it this frame, or
+// CULLED_LOD. Refilled each frame rather than rebuilt with frameStats.
+const unsigned int CULLED_LOD = ~0u;
+std::vector<unsigned int> entityLods;
+
+RenderQueue renderQueue;
+StateCache glState;
+
+GpuTimer frameTimer;
+std::map<GLuint, GpuTimer> passTimers;
+std::map<GLuint, GpuTimer> prepassTimers;
+
+bool showStats = false;
+int lastStatsTime = 0;
+
+Entity CreateEntity(MeshHandle mesh, GLuint texture, GLuint objectID)
 {
     Entity entity;
 
@@ -101,69 +231,81 @@ Entity CreateEntity(GLuint mesh, GLuint texture, GLuint objectID)
     return entity;
 }
 
-void DrawEntity(const Entity &entity, GLuint program)
+unsigned int SelectLod(const Entity &entity, const gl::Matrix4 &transform)
 {
-    modelview.push();
-    modelview.translate(entity.translation);
-    modelview.rotate(entity.rotation[1], 0, 1, 0);
-    modelview.rotate(entity.rotation[2], 0, 0, 1);
-    modelview.rotate(entity.rotation[0], 1, 0, 0);
-    modelview.scale(entity.scale);
-
-    if (entity.cull == GL_NONE)
-        glDisable(GL_CULL_FACE);
-    else
-    {
-        glEnable(GL_CULL_FACE);
-        glCullFace(entity.cull);
-    }
-
-    GLint locDiffuseColor = glGetUniformLocation(program, "diffuseColor");
-    if (locDiffuseColor >= 0)
-        glUniform3fv(locDiffuseColor, 1, &entity.diffuseColor[0]);
-
-    GLint locSpecularColor = glGetUniformLocation(program, "specularColor");
-    if (locSpecularColor >= 0)
-        glUniform3fv(locSpecularColor, 1, &entity.specularColor[0]);
-
-    GLint locShininess = glGetUniformLocation(program, "shininess");
-    if (locShininess >= 0)
-        glUniform1f(locShininess, entity.shininess);
-
-    GLint locAmbientLight = glGetUniformLocation(program, "ambientLight");
-    if (locAmbientLight >= 0)
-        glUniform3fv(locAmbientLight, 1, &ambientLight[0]);
+    const MeshEntry &mesh = meshes[entity.mesh];
+    const gl::Vector4 &sphere = mesh.bounds.sphere;
+    gl::Vector4 center = transform * gl::Vector4(sphere[0], sphere[1], sphere[2], 1);
+    float scale = std::max(entity.scale[0], std::max(entity.scale[1], entity.scale[2]));
+
+    // Distance to the nearest point of the bounding sphere
+    float distance = -center[2] - sphere[3] * scale;
+    if (distance <= 0)
+        return 0;
+
+    float pixelsPerUnit = screenHeight / (2 * distance * tan(RADIANS(FIELD_OF_VIEW / 2)));
+
+    unsigned int lod = 0;
+    while (lod + 1 < mesh.lodCount && mesh.lods[lod + 1].error * scale * pixelsPerUnit <= LOD_PIXEL_ERROR)
+        ++lod;
+    return lod;
+}
 
-    GLint locNumLights = glGetUniformLocation(program, "numLights");
-    if (locNumLights >= 0)
-        glUniform1ui(locNumLights, NUM_LIGHTS);
+// Uniform setters for the cached locations, skipping uniforms the program
+// doesn't use and counting the calls made
+void setUniform(GLint location, GLint value)
+{
+    if (location < 0)
+        return;
+    glUniform1i(location, value);
+    frameStats.glCalls++;
+}
 
-    GLint locLightPositions = glGetUniformLocation(program, "lightPositions");
-    if (locLightPositions >= 0)
-        glUniform4fv(locLightPositions, NUM_LIGHTS, &lightPositions[0][0]);
+void setUniform(GLint location, float value)
+{
+    if (location < 0)
+        return;
+    glUniform1f(location, value);
+    frameStats.glCalls++;
+}
 
-    GLint locLightColors = glGetUniformLocation(program, "lightColors");
-    if (locLightColors >= 0)
-        glUniform3fv(locLightColors, NUM_LIGHTS, &lightColors[0][0]);
+void setUniform(GLint location, const gl::Vector3 *values, GLsizei count = 1)
+{
+    if (location < 0)
+        return;
+    glUniform3fv(location, count, &values[0][0]);
+    frameStats.glCalls++;
+}
 
-    GLint locSelectedID = glGetUniformLocation(program, "selectedID");
-    if (locSelectedID >= 0)
-        glUniform1ui(locSelectedID, selected);
+// Adds an entity to the render queue, to be drawn with program, and
+// returns the level it will be drawn at
+unsigned int queueEntity(const Entity &entity, GLuint program)
+{
+    InstanceData instance;
+    gl::Matrix4 transform = modelview.top() * entityTransform(entity);
+    for (int c = 0; c < 4; ++c)
+        for (int r = 0; r < 4; ++r)
+            instance.modelview[c * 4 + r] = transform[c][r];
+    for (int c = 0; c < 3; ++c)
+    {
+        instance.diffuseColor[c] = entity.diffuseColor[c];
+        instance.specularColor[c] = entity.specularColor[c];
+    }
+    instance.shininess = entity.shininess;
+    instance.objectID = entity.objectID;
 
-    glUniform1ui(glGetUniformLocation(program, "objectID"), entity.objectID);
-    glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, &projection.top()[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(program, "modelview"), 1, GL_FALSE, &modelview.top()[0][0]);
+    const gl::Vector4 &sphere = meshes[entity.mesh].bounds.sphere;
+    float depth = -(transform * gl::Vector4(sphere[0], sphere[1], sphere[2], 1))[2];
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, tex[entity.texture]);
-    glBindVertexArray(vao[entity.mesh]);
-    glDrawArrays(vao_mode[entity.mesh], 0, vao_count[entity.mesh]);
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // Picks hit the full mesh, like pickEntity does
+    unsigned int lod = program == pickProgram ? 0 : SelectLod(entity, transform);
 
-    modelview.pop();
+    renderQueue.push(program, entity.cull, tex[entity.texture], entity.mesh, lod, depth, instance);
 
-    checkError("End of Draw Entity");
+    frameStats.instances++;
+    frameStats.triangles += meshes[entity.mesh].lods[lod].indexCount / 3;
+    frameStats.lodDraws[lod]++;
+    return lod;
 }
 
 void resetCamera()
@@ -197,65 +339,89 @@ void init()
     pickProgram = loadProgram("resources/shaders/pick.vert", "resources/shaders/pick.frag");
     geometryProgram = loadProgram("resources/shaders/geometry_pass.vert", "resources/shaders/geometry_pass.frag");
     renderPassProgram = loadProgram("resources/shaders/render_pass.vert", "resources/shaders/render_pass.frag");
+    overdrawProgram = loadProgram("resources/shaders/pick.vert", "resources/shaders/overdraw.frag");
+    overdrawViewProgram = loadProgram("resources/shaders/render_pass.vert", "resources/shaders/overdraw_view.frag");
+    depthProgram = loadProgram("resources/shaders/pick.vert", "resources/shaders/depth.frag");
 
     // Generate OpenGL objects
-    glGenVertexArrays(NUM_VERTEX_OBJECTS, vao);
-    glGenBuffers(NUM_VERTEX_OBJECTS, vao_buffer);
     glGenTextures(NUM_TEXTURES, tex);
+
+    GLuint queuedPrograms[] = { drawProgram, pickProgram, geometryProgram, overdrawProgram };
+    for (GLuint program : queuedPrograms)
+        renderQueue.addProgram(program);
+    for (GLuint texture : tex)
+        renderQueue.addTexture(texture);
     glGenFramebuffers(NUM_FRAMEBUFFERS, fbo);
 
-    // Load models
-    loadModel(CUBE_MESH, "resources/models/cube.obj");
-    loadModel(SKELETON_MESH, "resources/models/skeleton.obj");
-    loadModel(TABLE_MESH, "resources/models/table.obj");
-    loadModel(FLOOR_MESH, "resources/models/floor.obj");
-    loadModel(WALL_MESH, "resources/models/wall.obj");
-    loadModel(CHAIR_MESH, "resources/models/chair.obj");
-    loadModel(SHELVES_MESH, "resources/models/shelves.obj");
-    loadModel(CHEST_MESH, "resources/models/chest.obj");
-    loadModel(SPHERE_MESH, "resources/models/sphere.obj");
-
-    // Load textures
-    loadTexture(SMILE_TEXTURE, "resources/textures/smile.png");
-    loadTexture(SKELETON_TEXTURE, "resources/textures/skeleton.png");
-    loadTexture(TABLE_TEXTURE, "resources/textures/table.png");
-    loadTexture(FLOOR_TEXTURE, "resources/textures/floor.png");
-    loadTexture(WALL_TEXTURE, "resources/textures/wall.png");
-    loadTexture(CHAIR_TEXTURE, "resources/textures/chair.png");
-    loadTexture(SHELVES_TEXTURE, "resources/textures/shelves.png");
-    loadTexture(CHEST_TEXTURE, "resources/textures/chest.png");
-    loadTexture(SPHERE_TEXTURE, "resources/textures/sphere.png");
+    glGenBuffers(1, &pickBuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pickBuffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(GLuint), NULL, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    glGenBuffers(1, &frameUniformBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, frameUniformBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, frameUniformBuffer);
+
+    // Load models and textures, preferring the cooked pack when present
+    AssetManifest manifest;
+    manifest.load("resources/cooked/manifest.txt");
+
+    AssetLoader loader;
+    loader.setManifest(&manifest);
+    cubeMesh = loader.addModel("resources/models/cube.obj");
+    MeshHandle skeletonMesh = loader.addModel("resources/models/skeleton.obj");
+    MeshHandle tableMesh = loader.addModel("resources/models/table.obj");
+    MeshHandle floorMesh = loader.addModel("resources/models/floor.obj");
+    MeshHandle wallMesh = loader.addModel("resources/models/wall.obj");
+    MeshHandle chairMesh = loader.addModel("resources/models/chair.obj");
+    MeshHandle shelvesMesh = loader.addModel("resources/models/shelves.obj");
+    MeshHandle chestMesh = loader.addModel("resources/models/chest.obj");
+    MeshHandle sphereMesh = loader.addModel("resources/models/sphere.obj");
+
+    loader.addTexture(SMILE_TEXTURE, "resources/textures/smile.png");
+    loader.addTexture(SKELETON_TEXTURE, "resources/textures/skeleton.png");
+    loader.addTexture(TABLE_TEXTURE, "resources/textures/table.png");
+    loader.addTexture(FLOOR_TEXTURE, "resources/textures/floor.png");
+    loader.addTexture(WALL_TEXTURE, "resources/textures/wall.png");
+    loader.addTexture(CHAIR_TEXTURE, "resources/textures/chair.png");
+    loader.addTexture(SHELVES_TEXTURE, "resources/textures/shelves.png");
+    loader.addTexture(CHEST_TEXTURE, "resources/textures/chest.png");
+    loader.addTexture(SPHERE_TEXTURE, "resources/textures/sphere.png");
+    loader.run();
+    meshes.logUsage();
 
     gbuffer.Init(screenWidth, screenHeight);
 
     // Load entities
-    Entity floor = CreateEntity(FLOOR_MESH, FLOOR_TEXTURE, 2);
+    Entity floor = CreateEntity(floorMesh, FLOOR_TEXTURE, 2);
     floor.rotation = gl::Vector3(90, 0, 0);
     entities.push_back(floor);
 
-    Entity wall1 = CreateEntity(WALL_MESH, WALL_TEXTURE, 3);
+    Entity wall1 = CreateEntity(wallMesh, WALL_TEXTURE, 3);
     wall1.translation = gl::Vector3(0, 0, -5);
     entities.push_back(wall1);
 
-    Entity wall2 = CreateEntity(WALL_MESH, WALL_TEXTURE, 4);
+    Entity wall2 = CreateEntity(wallMesh, WALL_TEXTURE, 4);
     wall2.translation = gl::Vector3(-5, 0, 0);
     wall2.rotation = gl::Vector3(0, 90, 0);
     entities.push_back(wall2);
 
-    Entity table = CreateEntity(TABLE_MESH, TABLE_TEXTURE, 5);
+    Entity table = CreateEntity(tableMesh, TABLE_TEXTURE, 5);
     table.translation = gl::Vector3(0, 0.368736, 0);
     table.specularColor = gl::Vector3(0.9, 0.9, 0.9);
     table.shininess = 30;
     entities.push_back(table);
 
-    Entity chair1 = CreateEntity(CHAIR_MESH, CHAIR_TEXTURE, 7);
+    Entity chair1 = CreateEntity(chairMesh, CHAIR_TEXTURE, 7);
     chair1.translation = gl::Vector3(0, 0.555590, -1);
     chair1.specularColor = gl::Vector3(0.9, 0.9, 0.9);
     chair1.shininess = 30;
     chair1.cull = GL_NONE;
     entities.push_back(chair1);
 
-    Entity chair2 = CreateEntity(CHAIR_MESH, CHAIR_TEXTURE, 8);
+    Entity chair2 = CreateEntity(chairMesh, CHAIR_TEXTURE, 8);
     chair2.translation = gl::Vector3(0, 0.555590, 1);
     chair2.rotation = gl::Vector3(0, 180, 0);
     chair2.specularColor = gl::Vector3(0.9, 0.9, 0.9);
@@ -263,19 +429,19 @@ void init()
     chair2.cull = GL_NONE;
     entities.push_back(chair2);
 
-    Entity skeleton1 = CreateEntity(SKELETON_MESH, SKELETON_TEXTURE, 9);
+    Entity skeleton1 = CreateEntity(skeletonMesh, SKELETON_TEXTURE, 9);
     skeleton1.translation = gl::Vector3(1.5, 0, 0);
     skeleton1.scale = gl::Vector3(0.2, 0.2, 0.2);
     skeleton1.rotation = gl::Vector3(0, -90, 0);
     entities.push_back(skeleton1);
 
-    Entity skeleton2 = CreateEntity(SKELETON_MESH, SKELETON_TEXTURE, 10);
+    Entity skeleton2 = CreateEntity(skeletonMesh, SKELETON_TEXTURE, 10);
     skeleton2.translation = gl::Vector3(-1.5, 0, 0);
     skeleton2.scale = gl::Vector3(0.2, 0.2, 0.2);
     skeleton2.rotation = gl::Vector3(0, 90, 0);
     entities.push_back(skeleton2);
 
-    Entity shelves1 = CreateEntity(SHELVES_MESH, SHELVES_TEXTURE, 11);
+    Entity shelves1 = CreateEntity(shelvesMesh, SHELVES_TEXTURE, 11);
     shelves1.translation = gl::Vector3(-4.5, 1.09167975, 2);
     shelves1.scale = gl::Vector3(0.75, 0.75, 0.75);
     shelves1.rotation = gl::Vector3(0, -90, 0);
@@ -284,7 +450,7 @@ void init()
     shelves1.cull = GL_NONE;
     entities.push_back(shelves1);
 
-    Entity shelves2 = CreateEntity(SHELVES_MESH, SHELVES_TEXTURE, 12);
+    Entity shelves2 = CreateEntity(shelvesMesh, SHELVES_TEXTURE, 12);
     shelves2.translation = gl::Vector3(-4.5, 1.09167975, -2);
     shelves2.scale = gl::Vector3(0.75, 0.75, 0.75);
     shelves2.rotation = gl::Vector3(0, -90, 0);
@@ -293,7 +459,7 @@ void init()
     shelves2.cull = GL_NONE;
     entities.push_back(shelves2);
 
-    Entity shelves3 = CreateEntity(SHELVES_MESH, SHELVES_TEXTURE, 13);
+    Entity shelves3 = CreateEntity(shelvesMesh, SHELVES_TEXTURE, 13);
     shelves3.translation = gl::Vector3(-2, 1.09167975, -4.5);
     shelves3.scale = gl::Vector3(0.75, 0.75, 0.75);
     shelves3.rotation = gl::Vector3(0, 180, 0);
@@ -302,7 +468,7 @@ void init()
     shelves3.cull = GL_NONE;
     entities.push_back(shelves3);
 
-    Entity shelves4 = CreateEntity(SHELVES_MESH, SHELVES_TEXTURE, 14);
+    Entity shelves4 = CreateEntity(shelvesMesh, SHELVES_TEXTURE, 14);
     shelves4.translation = gl::Vector3(2, 1.09167975, -4.5);
     shelves4.scale = gl::Vector3(0.75, 0.75, 0.75);
     shelves4.rotation = gl::Vector3(0, 180, 0);
@@ -311,20 +477,37 @@ void init()
     shelves4.cull = GL_NONE;
     entities.push_back(shelves4);
 
-    Entity chest = CreateEntity(CHEST_MESH, CHEST_TEXTURE, 15);
+    Entity chest = CreateEntity(chestMesh, CHEST_TEXTURE, 15);
     chest.translation = gl::Vector3(0, 0.271628, 2.5);
     chest.rotation = gl::Vector3(0, 180, 0);
     chest.specularColor = gl::Vector3(0.9, 0.9, 0.9);
     chest.shininess = 30;
     entities.push_back(chest);
 
-    Entity sphere = CreateEntity(SPHERE_MESH, SPHERE_TEXTURE, 6);
+    Entity sphere = CreateEntity(sphereMesh, SPHERE_TEXTURE, 6);
     sphere.translation = gl::Vector3(0, 1.3, 0);
     sphere.scale = gl::Vector3(0.45, 0.45, 0.45);
     sphere.specularColor = gl::Vector3(0.9, 0.9, 0.9);
     sphere.shininess = 50;
     entities.push_back(sphere);
 
+    std::vector<Entity> furniture;
+    for (const Entity &entity : entities)
+        if (entity.mesh != floorMesh && entity.mesh != wallMesh)
+            furniture.push_back(entity);
+    unsigned int columns = (unsigned int) std::ceil(std::sqrt((float) stressCopies));
+    for (unsigned int i = 0; i < stressCopies; ++i)
+    {
+        Entity copy = furniture[i % furniture.size()];
+        copy.translation[0] = ((float) (i % columns) - (columns - 1) / 2.0f) * STRESS_SPACING;
+        copy.translation[2] = -6 - (float) (i / columns) * STRESS_SPACING;
+        copy.objectID = 16 + i;
+        entities.push_back(copy);
+    }
+
+    entityBvh.build(entities);
+    entityLods.assign(entities.size(), CULLED_LOD);
+
     checkError("End of Init");
 }
 
@@ -351,49 +534,261 @@ void reshape(int w, int h)
     if (Status != GL_FRAMEBUFFER_COMPLETE)
         fatalError("Framebuffer Status Error");
 
+    // Overdraw Framebuffer
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo[OVERDRAW_FRAMEBUFFER]);
+
+    glBindTexture(GL_TEXTURE_2D, tex[OVERDRAW_COUNT_TEXTURE]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, screenWidth, screenHeight, 0, GL_RED, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, tex[OVERDRAW_COUNT_TEXTURE], 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindTexture(GL_TEXTURE_2D, tex[OVERDRAW_DEPTH_TEXTURE]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, screenWidth, screenHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, tex[OVERDRAW_DEPTH_TEXTURE], 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    Status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (Status != GL_FRAMEBUFFER_COMPLETE)
+        fatalError("Framebuffer Status Error");
+
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
     gbuffer.Init(screenWidth, screenHeight);
 }
 
-void draw(GLuint program)
+void setCamera()
 {
-    glUseProgram(program);
-
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     projection.loadIdentity();
-    projection.prespective(60, float(screenWidth) / screenHeight, 0.01, 100);
+    projection.prespective(FIELD_OF_VIEW, float(screenWidth) / screenHeight, 0.01, 100);
 
     modelview.loadIdentity();
     modelview.lookAt(offset + eye, offset + center, up);
+}
+
+// Uploads the camera, lights and selection for every program to read
+void updateFrameUniforms()
+{
+    FrameUniforms frame = {};
+    const gl::Matrix4 &camera = projection.top();
+    for (int c = 0; c < 4; ++c)
+        for (int r = 0; r < 4; ++r)
+            frame.projection[c * 4 + r] = camera[c][r];
+    for (unsigned int i = 0; i < NUM_LIGHTS; ++i)
+        for (int c = 0; c < 4; ++c)
+        {
+            frame.lightPositions[i][c] = lightPositions[i][c];
+            frame.lightColors[i][c] = c < 3 ? lightColors[i][c] : 0;
+        }
+    for (int c = 0; c < 3; ++c)
+        frame.ambientLight[c] = ambientLight[c];
+    frame.numLights = NUM_LIGHTS;
+    frame.selectedID = selected;
+    frame.packedVertices = packedVertices;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, frameUniformBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(frame), &frame);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    frameStats.glCalls += 3;
+}
+
+// Draws what is queued, with program in place of the queued programs
+// unless it is 0
+void submitRenderQueue(RenderOrder order, GLuint program)
+{
+    SubmitStats submitted = renderQueue.submit(glState, order, program);
+    frameStats.draws += submitted.draws;
+    frameStats.vertexArrayBinds += submitted.vertexArrayBinds;
+    frameStats.glCalls += submitted.glCalls;
+}
+
+void draw(GLuint program)
+{
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    frameStats.glCalls++;
+    setCamera();
 
     for (int i = 0; i < NUM_LIGHTS; ++i)
         lightPositions[i] = modelview.top() * globalLightPositions[i];
+    updateFrameUniforms();
 
-    if (!hidecursor)
+    // The cursor can't be picked, so clicks go through it
+    if (!hidecursor && program != pickProgram)
     {
-        Entity cursor = CreateEntity(CUBE_MESH, SMILE_TEXTURE, 0xFFFFFF);
+        Entity cursor = CreateEntity(cubeMesh, SMILE_TEXTURE, 0xFFFFFF);
         cursor.translation = offset;
         cursor.scale = gl::Vector3(0.05, 0.05, 0.05);
-        DrawEntity(cursor, program);
+        queueEntity(cursor, program);
+    }
+
+    std::vector<GLuint> visible;
+    entityBvh.cull(extractFrustum(projection.top() * modelview.top()), visible);
+    for (GLuint index : visible)
+        entityLods[index] = queueEntity(entities[index], program);
+
+    bool opaquePass = program == geometryProgram || program == pickProgram || program == overdrawProgram;
+    RenderOrder order = frontToBack && opaquePass ? FRONT_TO_BACK_ORDER : STATE_ORDER;
+
+    // The pick pass only writes IDs, so a depth pre-pass saves it nothing
+    bool prepass = program == drawProgram ? forwardDepthPrepass
+                                          : deferredDepthPrepass && program != pickProgram;
+
+    // Passes outside the queue change state directly
+    glState.reset();
+    glState.resetCounts();
+    PassStats pass = { program, (unsigned int) visible.size(), (unsigned int) (entities.size() - visible.size()), -1, -1 };
+    if (prepass)
+    {
+        GpuTimer &timer = prepassTimers[program];
+        pass.prepassMilliseconds = timer.milliseconds();
+        timer.begin();
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        submitRenderQueue(FRONT_TO_BACK_ORDER, depthProgram);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+        timer.end();
+        frameStats.glCalls += 4;
     }
 
-    for (Entity entity : entities)
-        DrawEntity(entity, program);
+    GpuTimer &timer = passTimers[program];
+    pass.milliseconds = timer.milliseconds();
+    timer.begin();
+    submitRenderQueue(order, 0);
+    timer.end();
+    renderQueue.clear();
+    meshes.unbind();
+    frameStats.glCalls++;
+    if (prepass)
+    {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+        frameStats.glCalls += 2;
+    }
+    frameStats.stateRequests += glState.requests();
+    frameStats.stateChanges += glState.changes();
+    frameStats.passes.push_back(pass);
+}
+
+void selectObject(GLuint objectID)
+{
+    selected = objectID;
+    for (unsigned int i = 0; i < entities.size(); ++i)
+    {
+        if (entities[i].objectID == selected)
+        {
+            selectedIndex = i;
+            break;
+        }
+    }
 }
 
 void pick()
 {
+    int windowY = screenHeight - pickRequest.y;
+
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo[PICK_FRAMEBUFFER]);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(pickRequest.x - PICK_REGION / 2, windowY - PICK_REGION / 2, PICK_REGION, PICK_REGION);
 
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
     draw(pickProgram);
 
+    glDisable(GL_SCISSOR_TEST);
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
 
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo[PICK_FRAMEBUFFER]);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pickBuffer);
+    glReadPixels(pickRequest.x, windowY, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_INT, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+    if (pickRequest.fence)
+        glDeleteSync(pickRequest.fence);
+    pickRequest.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    pickRequest.requested = false;
+
     checkError("End of Pick");
 }
 
+// Applies the last pick once the GPU has written it
+void resolvePick()
+{
+    if (!pickRequest.fence || glClientWaitSync(pickRequest.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+        return;
+
+    glDeleteSync(pickRequest.fence);
+    pickRequest.fence = 0;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pickBuffer);
+    const GLuint *id = (const GLuint *) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sizeof(GLuint), GL_MAP_READ_BIT);
+    if (id)
+    {
+        selectObject(*id);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+// Draws the whole pick buffer for each of PICK_CHECK_VIEWS and compares it
+// with pickEntity. A pixel on a silhouette may be covered on one side and
+// not the other, so a CPU result that the GPU wrote to a neighbouring pixel
+// counts as an edge rather than a mismatch.
+bool checkPicking()
+{
+    std::vector<GLuint> pixels(screenWidth * screenHeight);
+    size_t total = 0, edges = 0, mismatches = 0;
+    for (const PickCheckView &view : PICK_CHECK_VIEWS)
+    {
+        xRot = view.xRot;
+        yRot = view.yRot;
+        zoom = view.zoom;
+        eye = gl::Vector3(zoom * sin(RADIANS(xRot)) * cos(RADIANS(yRot)),
+                          zoom * sin(RADIANS(yRot)),
+                          zoom * cos(RADIANS(xRot)) * cos(RADIANS(yRot)));
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo[PICK_FRAMEBUFFER]);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        draw(pickProgram);
+        glReadPixels(0, 0, screenWidth, screenHeight, GL_RED_INTEGER, GL_UNSIGNED_INT, pixels.data());
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        checkError("Pick check");
+
+        gl::Matrix4 viewProjection = projection.top() * modelview.top();
+        for (int y = 0; y < screenHeight; y += PICK_CHECK_STEP)
+        {
+            for (int x = 0; x < screenWidth; x += PICK_CHECK_STEP)
+            {
+                GLuint gpu = pixels[y * screenWidth + x];
+                GLuint cpu = pickEntity(entities, entityBvh, viewProjection,
+                                        (x + 0.5f) / screenWidth * 2 - 1, (y + 0.5f) / screenHeight * 2 - 1);
+                ++total;
+                if (gpu == cpu)
+                    continue;
+
+                bool edge = false;
+                for (int ny = std::max(0, y - 1); ny <= std::min(screenHeight - 1, y + 1); ++ny)
+                    for (int nx = std::max(0, x - 1); nx <= std::min(screenWidth - 1, x + 1); ++nx)
+                        edge |= pixels[ny * screenWidth + nx] == cpu;
+                if (edge)
+                {
+                    ++edges;
+                    continue;
+                }
+
+                if (++mismatches <= 10)
+                {
+                    std::cout << "  Zoom " << zoom << " pixel " << x << ", " << y << ": GPU picked " << gpu
+                              << " CPU picked " << cpu << std::endl;
+                }
+            }
+        }
+    }
+
+    std::cout << "Pick check picks: " << total << " edges: " << edges << " mismatches: " << mismatches << std::endl;
+    return mismatches == 0;
+}
+
 void drawGeometryBuffers()
 {
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -424,6 +819,34 @@ void drawGeometryBuffers()
     gbuffer.UnbindForReading();
 }
 
+// Covers the viewport with one quad for a full screen pass
+void drawScreenQuad()
+{
+    GLuint qVAO, qVBO;
+    glGenVertexArrays(1, &qVAO);
+    glBindVertexArray(qVAO);
+
+    glGenBuffers(1, &qVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, qVBO);
+
+    float vertex[] = {
+        -1, -1, 0,
+         1, -1, 0,
+         1,  1, 0,
+        -1,  1, 0
+    };
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertex), vertex, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(0);
+
+    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+
+    glDeleteBuffers(1, &qVBO);
+    glBindVertexArray(0);
+    glDeleteVertexArrays(1, &qVAO);
+    frameStats.glCalls += 11;
+}
+
 void display4()
 {
     glClearColor(0.1f, 0.1f, 0.2f, 1.0f);
@@ -438,8 +861,6 @@ void display4()
 
 void display1()
 {
-    pick();
-
     glClearColor(0.1f, 0.1f, 0.2f, 1.0f);
     draw(drawProgram);
 
@@ -466,8 +887,6 @@ void display2()
 
 void display3()
 {
-    pick();
-
     gbuffer.BindForWriting();
     draw(geometryProgram);
     gbuffer.UnbindForWriting();
@@ -476,92 +895,133 @@ void display3()
     glClearColor(0.1f, 0.1f, 0.2f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glUseProgram(renderPassProgram);
+    frameStats.glCalls += 3;
 
-    GLint locScreenWidth = glGetUniformLocation(renderPassProgram, "screenWidth");
-    if (locScreenWidth >= 0)
-        glUniform1f(locScreenWidth, (float) screenWidth);
+    const GLint *uniforms = uniformLocations(renderPassProgram);
+    setUniform(uniforms[SCREEN_WIDTH_UNIFORM], (float) screenWidth);
+    setUniform(uniforms[SCREEN_HEIGHT_UNIFORM], (float) screenHeight);
+    setUniform(uniforms[TEX_POSITION_UNIFORM], 0);
+    setUniform(uniforms[TEX_DIFFUSE_UNIFORM], 1);
+    setUniform(uniforms[TEX_NORMAL_UNIFORM], 2);
+    setUniform(uniforms[TEX_DIFFUSE_COLOR_UNIFORM], 4);
+    setUniform(uniforms[TEX_SPECULAR_COLOR_UNIFORM], 5);
+    setUniform(uniforms[TEX_SHININESS_UNIFORM], 6);
 
-    GLint locScreenHeight = glGetUniformLocation(renderPassProgram, "screenHeight");
-    if (locScreenHeight >= 0)
-        glUniform1f(locScreenHeight, (float) screenHeight);
+    drawScreenQuad();
 
-    GLint locTexPosition = glGetUniformLocation(renderPassProgram, "texPosition");
-    if (locTexPosition >= 0)
-        glUniform1i(locTexPosition, 0);
-
-    GLint locTexDiffuse = glGetUniformLocation(renderPassProgram, "texDiffuse");
-    if (locTexDiffuse >= 0)
-        glUniform1i(locTexDiffuse, 1);
-
-    GLint locTexNormal = glGetUniformLocation(renderPassProgram, "texNormal");
-    if (locTexNormal >= 0)
-        glUniform1i(locTexNormal, 2);
-
-    GLint locTexDiffuseColor = glGetUniformLocation(renderPassProgram, "texDiffuseColor");
-    if (locTexDiffuseColor >= 0)
-        glUniform1i(locTexDiffuseColor, 4);
-
-    GLint locTexSpecularColor = glGetUniformLocation(renderPassProgram, "texSpecularColor");
-    if (locTexSpecularColor >= 0)
-        glUniform1i(locTexSpecularColor, 5);
-
-    GLint locTexShininess = glGetUniformLocation(renderPassProgram, "texShininess");
-    if (locTexShininess >= 0)
-        glUniform1i(locTexShininess, 6);
-
-    GLint locAmbientLight = glGetUniformLocation(renderPassProgram, "ambientLight");
-    if (locAmbientLight >= 0)
-        glUniform3fv(locAmbientLight, 1, &ambientLight[0]);
+    glFlush();
+    glutSwapBuffers();
 
-    GLint locNumLights = glGetUniformLocation(renderPassProgram, "numLights");
-    if (locNumLights >= 0)
-        glUniform1ui(locNumLights, NUM_LIGHTS);
+    checkError("End of Display");
+}
 
-    GLint locLightPositions = glGetUniformLocation(renderPassProgram, "lightPositions");
-    if (locLightPositions >= 0)
-        glUniform4fv(locLightPositions, NUM_LIGHTS, &lightPositions[0][0]);
+// Counts how many times each pixel is written by the geometry pass and
+// shows it as a heat map
+void display5()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo[OVERDRAW_FRAMEBUFFER]);
+    glClearColor(0, 0, 0, 0);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    draw(overdrawProgram);
+    glDisable(GL_BLEND);
+
+    std::vector<float> counts(screenWidth * screenHeight);
+    glReadPixels(0, 0, screenWidth, screenHeight, GL_RED, GL_FLOAT, &counts[0]);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    frameStats.glCalls += 7;
 
-    GLint locLightColors = glGetUniformLocation(renderPassProgram, "lightColors");
-    if (locLightColors >= 0)
-        glUniform3fv(locLightColors, NUM_LIGHTS, &lightColors[0][0]);
+    frameStats.overdrawFragments = 0;
+    frameStats.overdrawPixels = 0;
+    for (float count : counts)
+    {
+        frameStats.overdrawFragments += (unsigned int) count;
+        frameStats.overdrawPixels += count > 0;
+    }
 
-    GLint locSelectedID = glGetUniformLocation(renderPassProgram, "selectedID");
-    if (locSelectedID >= 0)
-        glUniform1ui(locSelectedID, selected);
-    
-    GLuint qVAO, qVBO;
-    glGenVertexArrays(1, &qVAO);
-    glBindVertexArray(qVAO);
+    glClearColor(0.1f, 0.1f, 0.2f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glUseProgram(overdrawViewProgram);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, tex[OVERDRAW_COUNT_TEXTURE]);
+    drawScreenQuad();
+    glBindTexture(GL_TEXTURE_2D, 0);
+    frameStats.glCalls += 6;
 
-    glGenBuffers(1, &qVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, qVBO);
+    glFlush();
+    glutSwapBuffers();
 
-    float vertex[] = {
-        -1, -1, 0,
-         1, -1, 0,
-         1,  1, 0,
-        -1,  1, 0
-    };
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertex), vertex, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(0);
+    checkError("End of Display");
+}
 
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+void printFrameStats()
+{
+    std::cout << "Frame draws: " << frameStats.draws << " instances: " << frameStats.instances << " vertex array binds: " << frameStats.vertexArrayBinds
+              << " triangles: " << frameStats.triangles << " GL calls: " << frameStats.glCalls << " LOD draws:";
+    for (unsigned int lod = 0; lod < MAX_MESH_LODS; ++lod)
+        std::cout << " " << frameStats.lodDraws[lod];
+    std::cout << std::endl;
+    if (frameStats.gpuMilliseconds >= 0)
+        std::cout << "  GPU frame: " << frameStats.gpuMilliseconds << " ms" << std::endl;
+    std::cout << "  State changes requested: " << frameStats.stateRequests << " made: " << frameStats.stateChanges << std::endl;
+    if (frameStats.overdrawPixels > 0)
+        std::cout << "  Overdraw fragments: " << frameStats.overdrawFragments << " pixels: " << frameStats.overdrawPixels
+                  << " per pixel: " << (float) frameStats.overdrawFragments / frameStats.overdrawPixels
+                  << (frontToBack ? " (front to back)" : " (state order)") << std::endl;
+
+    for (const PassStats &pass : frameStats.passes)
+    {
+        const char *name = pass.program == pickProgram ? "pick" :
+                           pass.program == geometryProgram ? "geometry" :
+                           pass.program == overdrawProgram ? "overdraw" : "forward";
+        std::cout << "  Pass " << name << " drawn: " << pass.drawn << " culled: " << pass.culled;
+        if (pass.prepassMilliseconds >= 0)
+            std::cout << " depth pre-pass: " << pass.prepassMilliseconds << " ms";
+        if (pass.milliseconds >= 0)
+            std::cout << " GPU: " << pass.milliseconds << " ms";
+        std::cout << std::endl;
+    }
 
-    glDeleteBuffers(1, &qVBO);
-    glBindVertexArray(0);
-    glDeleteVertexArrays(1, &qVAO);
+    if (entities.size() > MAX_LISTED_OBJECTS)
+        return;
 
-    glFlush();
-    glutSwapBuffers();
+    for (size_t index = 0; index < entities.size(); ++index)
+    {
+        const Entity &entity = entities[index];
+        unsigned int lod = entityLods[index];
+        if (lod == CULLED_LOD)
+        {
+            std::cout << "  Object " << entity.objectID << " culled" << std::endl;
+            continue;
+        }
 
-    checkError("End of Display");
+        std::cout << "  Object " << entity.objectID << " LOD " << lod << " triangles:";
+        const MeshEntry &mesh = meshes[entity.mesh];
+        for (unsigned int i = 0; i < mesh.lodCount; ++i)
+            std::cout << (i == lod ? " [" : " ") << mesh.lods[i].indexCount / 3 << (i == lod ? "]" : "");
+        std::cout << std::endl;
+    }
 }
 
 void (*currentDisplay)() = display1;
 void display()
 {
+    frameStats = FrameStats();
+    entityLods.assign(entities.size(), CULLED_LOD);
+    resolvePick();
+    if (pickRequest.requested)
+        pick();
+    frameStats.gpuMilliseconds = frameTimer.milliseconds();
+    frameTimer.begin();
     currentDisplay();
+    frameTimer.end();
+
+    int time = glutGet(GLUT_ELAPSED_TIME);
+    if (showStats && time - lastStatsTime >= 1000)
+    {
+        printFrameStats();
+        lastStatsTime = time;
+    }
 }
 
 void mouse(int button, int state, int x, int y)
@@ -672,20 +1132,33 @@ void key(unsigned char key, int x, int y)
     {
         currentDisplay = display3;
     }
+    else if (key == '5')
+    {
+        currentDisplay = display5;
+    }
+    else if (key == 'f')
+    {
+        frontToBack = !frontToBack;
+    }
+    else if (key == 'v')
+    {
+        bool &prepass = currentDisplay == display1 ? forwardDepthPrepass : deferredDepthPrepass;
+        prepass = !prepass;
+    }
     else if (key == 'p')
     {
-        unsigned int id;
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo[PICK_FRAMEBUFFER]);
-        glReadPixels(x, screenHeight - y, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_INT, &id);
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
-        selected = id;
-        for (unsigned int i = 0; i < entities.size(); ++i)
+        if (cpuPicking)
         {
-            if (entities[i].objectID == selected)
-            {
-                selectedIndex = i;
-                break;
-            }
+            // Through the centre of the pixel the pick pass would read
+            setCamera();
+            selectObject(pickEntity(entities, entityBvh, projection.top() * modelview.top(),
+                                    (x + 0.5f) / screenWidth * 2 - 1, (screenHeight - y + 0.5f) / screenHeight * 2 - 1));
+        }
+        else
+        {
+            pickRequest.requested = true;
+            pickRequest.x = x;
+            pickRequest.y = y;
         }
     }
     else if (key == 'o')
@@ -708,6 +1181,10 @@ void key(unsigned char key, int x, int y)
     {
         hidecursor = !hidecursor;
     }
+    else if (key == 'i')
+    {
+        showStats = !showStats;
+    }
     else if (selected != 0)
     {
         if (key == 'w')
@@ -779,12 +1256,29 @@ void key(unsigned char key, int x, int y)
             std::cout << "Scale Edit Mode" << std::endl;
             editMode = SCALE;
         }
+        entityBvh.refit(selectedIndex, entities[selectedIndex]);
     }
 }
 
 int main(int argc, char *argv[])
 {
     glutInit(&argc, argv);
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::string(argv[i]) == "--packed-vertices")
+            packedVertices = true;
+        else if (std::string(argv[i]) == "--stream-budget" && i + 1 < argc)
+            streamingBudget = (size_t) std::strtoul(argv[++i], 0, 10) << 20;
+        else if (std::string(argv[i]) == "--cpu-picking")
+            cpuPicking = true;
+        else if (std::string(argv[i]) == "--pick-check")
+            pickCheck = cpuPicking = true;
+        else if (std::string(argv[i]) == "--depth-prepass")
+            forwardDepthPrepass = deferredDepthPrepass = true;
+        else if (std::string(argv[i]) == "--stress" && i + 1 < argc)
+            stressCopies = (unsigned int) std::strtoul(argv[++i], 0, 10);
+    }
     glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH | GLUT_PLATFORM_FLAG);
     glutInitWindowSize(screenWidth, screenHeight);
     glutCreateWindow("CS211B - Project 1");
@@ -815,6 +1309,8 @@ int main(int argc, char *argv[])
 
     init();
     reshape(screenWidth, screenHeight);
+    if (pickCheck)
+        return checkPicking() ? 0 : 1;
 
     glutMainLoop();
 
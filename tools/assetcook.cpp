@@ -0,0 +1,192 @@
+
+// assetcook: converts resources/models/*.obj and resources/textures/*.png
+// into GPU-ready files under resources/cooked and writes the manifest the
+// renderer reads at startup. Every cooked mesh is read back the way the
+// renderer reads it and compared against a second, independent load of its
+// source, and every cooked texture against the decoded image, before it is
+// added to the manifest.
+//
+// Usage: assetcook [resourceDirectory] [outputDirectory]
+// Build from the repository root together with the renderer sources, e.g.
+//   g++ -std=c++11 -Isrc tools/assetcook.cpp src/ObjLoader.cpp src/MeshCache.cpp src/MeshOptimizer.cpp
+//       src/MeshSimplifier.cpp src/MeshRegistry.cpp src/Bounds.cpp src/TriangleBvh.cpp src/CookedAssets.cpp src/VertexPacking.cpp
+//       src/Util.cpp src/Math.cpp src/stb_image.c -lGLEW -lGL -pthread
+
+#include "CookedAssets.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshRegistry.h"
+#include "MeshSimplifier.h"
+#include "ObjLoader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include <sys/stat.h>
+#if _WIN32
+#include <direct.h>
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+// The shared loaders reference the renderer's GL object tables.
+MeshRegistry meshes;
+GLuint tex[NUM_TEXTURES];
+GLuint fbo[NUM_FRAMEBUFFERS];
+bool packedVertices = false;
+size_t streamingBudget = 0;
+bool cpuPicking = false;
+
+namespace
+{
+    std::vector<std::string> listFiles(const std::string &directory, const std::string &extension)
+    {
+        std::vector<std::string> names;
+#if _WIN32
+        WIN32_FIND_DATAA data;
+        HANDLE find = FindFirstFileA((directory + "/*" + extension).c_str(), &data);
+        if (find != INVALID_HANDLE_VALUE)
+        {
+            do
+                names.push_back(data.cFileName);
+            while (FindNextFileA(find, &data));
+            FindClose(find);
+        }
+#else
+        DIR *dir = opendir(directory.c_str());
+        if (dir)
+        {
+            while (struct dirent *entry = readdir(dir))
+            {
+                std::string name = entry->d_name;
+                if (name.size() > extension.size() &&
+                    name.compare(name.size() - extension.size(), extension.size(), extension) == 0)
+                    names.push_back(name);
+            }
+            closedir(dir);
+        }
+#endif
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
+    void makeDirectory(const std::string &directory)
+    {
+#if _WIN32
+        _mkdir(directory.c_str());
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+    }
+
+    MeshData loadModel(const std::string &source)
+    {
+        // As the renderer builds a model that has no cooked or cached copy
+        MeshData mesh = LoadIndexedOBJ(source);
+        optimizeMesh(mesh, source);
+        generateLods(mesh, source);
+        return mesh;
+    }
+
+    bool cookModel(const std::string &source, const std::string &cooked)
+    {
+        struct stat info;
+        if (stat(source.c_str(), &info) != 0)
+            return false;
+
+        MeshData mesh = loadModel(source);
+        if (!writeMeshFile(cooked, mesh, (uint64_t) info.st_size, (int64_t) info.st_mtime))
+            return false;
+
+        // A fresh load catches cooking that depends on more than the source
+        MeshData expected = loadModel(source);
+        unsigned int lodCount = (unsigned int) std::min<size_t>(std::max<size_t>(expected.lods.size(), 1), MAX_MESH_LODS);
+        CachedMesh check;
+        if (!readCookedMesh(cooked, source, check) ||
+            check.header->vertexCount != expected.vertices.size() ||
+            check.header->indexCount != expected.indices.size() ||
+            memcmp(check.vertices, &expected.vertices[0], sizeof(Vertex) * expected.vertices.size()) != 0 ||
+            check.header->lodCount != lodCount ||
+            (!expected.lods.empty() && memcmp(check.header->lods, &expected.lods[0], sizeof(MeshLod) * lodCount) != 0))
+            return false;
+
+        for (size_t i = 0; i < expected.indices.size(); ++i)
+        {
+            GLuint index = check.header->indexType == GL_UNSIGNED_SHORT
+                ? ((const GLushort *) check.indices)[i]
+                : ((const GLuint *) check.indices)[i];
+            if (index != expected.indices[i])
+                return false;
+        }
+
+        return true;
+    }
+
+    bool cookTexture(const std::string &source, const std::string &cooked)
+    {
+        TextureData texture = decodeTexture(source);
+        bool ok = writeCookedTexture(cooked, texture);
+
+        CookedTexture check;
+        ok = ok && readCookedTexture(cooked, check) &&
+             check.levelWidth[0] == texture.width &&
+             check.levelHeight[0] == texture.height &&
+             memcmp(check.levels[0], texture.pixels, (size_t) texture.width * texture.height * 4) == 0;
+
+        if (ok)
+            std::cout << "Cooked Texture '" << cooked << "' levels: " << check.levelCount << std::endl;
+
+        freeTexture(texture);
+        return ok;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::string resources = argc > 1 ? argv[1] : "resources";
+    std::string output = argc > 2 ? argv[2] : resources + "/cooked";
+
+    makeDirectory(output);
+    makeDirectory(output + "/models");
+    makeDirectory(output + "/textures");
+
+    AssetManifest manifest;
+    int failures = 0;
+
+    for (const std::string &name : listFiles(resources + "/models", ".obj"))
+    {
+        std::string source = resources + "/models/" + name;
+        std::string cooked = output + "/models/" + name + ".mesh";
+        if (cookModel(source, cooked))
+            manifest.addModel(source, cooked);
+        else
+        {
+            std::cerr << "Failed to cook model '" << source << "'" << std::endl;
+            ++failures;
+        }
+    }
+
+    for (const std::string &name : listFiles(resources + "/textures", ".png"))
+    {
+        std::string source = resources + "/textures/" + name;
+        std::string cooked = output + "/textures/" + name + ".tex";
+        if (cookTexture(source, cooked))
+            manifest.addTexture(source, cooked);
+        else
+        {
+            std::cerr << "Failed to cook texture '" << source << "'" << std::endl;
+            ++failures;
+        }
+    }
+
+    if (!manifest.save(output + "/manifest.txt"))
+    {
+        std::cerr << "Could not write manifest '" << output << "/manifest.txt'" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Wrote '" << output << "/manifest.txt'" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,211 @@
+// boundscheck: checks computeBounds and transformBounds against brute force
+// over the vertices of every model. The box must match the vertex extremes
+// exactly and the sphere must hold every vertex. Under random entity
+// transforms, including mirroring scales, the transformed box must hold
+// every transformed vertex and match the box of the transformed corners,
+// and the transformed sphere must hold every transformed vertex. A single
+// position in an array of exactly that size is checked too; build with
+// -fsanitize=address to catch reads past it. Exits non-zero on any failure.
+//
+// Usage: boundscheck [model.obj...]
+// Defaults to every model the renderer loads. Build from the repository
+// root together with the renderer sources, e.g.
+//   g++ -std=c++11 -O2 -Isrc tools/boundscheck.cpp src/Bounds.cpp src/ObjLoader.cpp src/MeshCache.cpp
+//       src/MeshOptimizer.cpp src/MeshSimplifier.cpp src/MeshRegistry.cpp src/TriangleBvh.cpp
+//       src/CookedAssets.cpp src/VertexPacking.cpp src/Util.cpp src/Math.cpp src/stb_image.c
+//       -lGLEW -lGL -pthread
+
+#include "Bounds.h"
+#include "MeshRegistry.h"
+#include "ObjLoader.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+// The shared loaders reference the renderer's GL object tables.
+MeshRegistry meshes;
+GLuint tex[NUM_TEXTURES];
+GLuint fbo[NUM_FRAMEBUFFERS];
+bool packedVertices = false;
+size_t streamingBudget = 0;
+bool cpuPicking = false;
+
+namespace
+{
+    const int TRANSFORM_COUNT = 200;
+
+    const char *const MODELS[] =
+    {
+        "resources/models/chair.obj",
+        "resources/models/chest.obj",
+        "resources/models/cube.obj",
+        "resources/models/floor.obj",
+        "resources/models/shelves.obj",
+        "resources/models/skeleton.obj",
+        "resources/models/sphere.obj",
+        "resources/models/table.obj",
+        "resources/models/wall.obj"
+    };
+
+    struct Box
+    {
+        Box() : minimum(FLT_MAX, FLT_MAX, FLT_MAX), maximum(-FLT_MAX, -FLT_MAX, -FLT_MAX) {}
+
+        void grow(const gl::Vector3 &p)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                minimum[c] = std::min(minimum[c], p[c]);
+                maximum[c] = std::max(maximum[c], p[c]);
+            }
+        }
+
+        gl::Vector3 minimum;
+        gl::Vector3 maximum;
+    };
+
+    bool contains(const Bounds &bounds, const gl::Vector3 &p, float tolerance)
+    {
+        for (int c = 0; c < 3; ++c)
+            if (p[c] < bounds.minimum[c] - tolerance || p[c] > bounds.maximum[c] + tolerance)
+                return false;
+        return (p - gl::Vector3(bounds.sphere)).length() <= bounds.sphere[3] + tolerance;
+    }
+
+    bool sameBox(const Bounds &bounds, const Box &box, float tolerance)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            if (std::fabs(bounds.minimum[c] - box.minimum[c]) > tolerance ||
+                std::fabs(bounds.maximum[c] - box.maximum[c]) > tolerance)
+                return false;
+        }
+        return true;
+    }
+
+    // Runs of every length up to a few, so the scalar tail after the SSE
+    // loop is covered, then all of the positions.
+    int checkComputed(const std::vector<Vertex> &vertices, const std::vector<gl::Vector3> &positions)
+    {
+        int failures = 0;
+        for (size_t count = 1; count <= positions.size(); count = count < 8 ? count + 1 : positions.size())
+        {
+            Box box;
+            for (size_t i = 0; i < count; ++i)
+                box.grow(positions[i]);
+
+            Bounds strided = computeBounds(&vertices[0].position, count, sizeof(Vertex));
+            Bounds packed = computeBounds(positions.data(), count);
+            if (!sameBox(strided, box, 0) || !sameBox(packed, box, 0))
+            {
+                std::cout << "  box of " << count << " positions differs from brute force" << std::endl;
+                ++failures;
+            }
+
+            float tolerance = 1e-5f * (1 + strided.sphere[3]);
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (!contains(strided, positions[i], tolerance))
+                {
+                    std::cout << "  position " << i << " of " << count << " outside the sphere" << std::endl;
+                    ++failures;
+                    break;
+                }
+            }
+            if (count == positions.size())
+                break;
+        }
+        return failures;
+    }
+
+    // A lone tightly packed position, as streamModel passes for a one-vertex
+    // mesh, must come back as a point and must not be read past
+    int checkSingle()
+    {
+        std::vector<gl::Vector3> positions(1, gl::Vector3(-2.5f, 7, 1e4f));
+        Bounds bounds = computeBounds(positions.data(), positions.size());
+        Box box;
+        box.grow(positions[0]);
+        if (!sameBox(bounds, box, 0) || bounds.sphere[3] != 0)
+        {
+            std::cout << "FAIL single position" << std::endl;
+            return 1;
+        }
+        std::cout << "ok   single position" << std::endl;
+        return 0;
+    }
+
+    int checkTransformed(const Bounds &bounds, const std::vector<gl::Vector3> &positions, std::mt19937 &random)
+    {
+        std::uniform_real_distribution<float> translation(-10, 10);
+        std::uniform_real_distribution<float> angle(0, 360);
+        std::uniform_real_distribution<float> size(0.1f, 3);
+        std::uniform_int_distribution<int> mirror(0, 3);
+
+        int failures = 0;
+        for (int t = 0; t < TRANSFORM_COUNT; ++t)
+        {
+            Entity entity;
+            entity.translation = gl::Vector3(translation(random), translation(random), translation(random));
+            entity.rotation = gl::Vector3(angle(random), angle(random), angle(random));
+            entity.scale = gl::Vector3(size(random), size(random), size(random) * (mirror(random) ? 1 : -1));
+
+            gl::Matrix4 transform = entityTransform(entity);
+            Bounds world = transformBounds(bounds, entity);
+            float tolerance = 1e-4f * (1 + world.sphere[3]);
+
+            Box corners;
+            for (int corner = 0; corner < 8; ++corner)
+            {
+                gl::Vector3 p(corner & 1 ? bounds.maximum[0] : bounds.minimum[0],
+                              corner & 2 ? bounds.maximum[1] : bounds.minimum[1],
+                              corner & 4 ? bounds.maximum[2] : bounds.minimum[2]);
+                corners.grow(gl::Vector3(transform * gl::Vector4(p, 1)));
+            }
+            if (!sameBox(world, corners, tolerance))
+            {
+                std::cout << "  transform " << t << ": box differs from the transformed corners" << std::endl;
+                ++failures;
+            }
+
+            for (const gl::Vector3 &position : positions)
+            {
+                if (!contains(world, gl::Vector3(transform * gl::Vector4(position, 1)), tolerance))
+                {
+                    std::cout << "  transform " << t << ": transformed vertex outside the bounds" << std::endl;
+                    ++failures;
+                    break;
+                }
+            }
+        }
+        return failures;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> filenames(MODELS, MODELS + sizeof(MODELS) / sizeof(MODELS[0]));
+    if (argc > 1)
+        filenames.assign(argv + 1, argv + argc);
+
+    std::mt19937 random(1);
+    int failures = checkSingle();
+    for (const std::string &filename : filenames)
+    {
+        MeshData mesh = LoadIndexedOBJ(filename);
+        std::vector<gl::Vector3> positions;
+        for (const Vertex &vertex : mesh.vertices)
+            positions.push_back(vertex.position);
+
+        int modelFailures = checkComputed(mesh.vertices, positions);
+        modelFailures += checkTransformed(computeBounds(positions.data(), positions.size()), positions, random);
+        std::cout << (modelFailures ? "FAIL " : "ok   ") << filename << std::endl;
+        failures += modelFailures;
+    }
+
+    std::cout << (failures ? "Bounds checks failed" : "All bounds checks passed") << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,170 @@
+
+// bvhbench: scatters unit cubes through a large room and times building,
+// refitting and querying the entity BVH against a linear scan over the same
+// bounds. Every query result is checked against the scan.
+//
+// Usage: bvhbench [entityCount] [seed]
+// Build from the repository root together with the renderer sources, e.g.
+//   g++ -std=c++11 -O2 -Isrc tools/bvhbench.cpp src/EntityBvh.cpp src/TriangleBvh.cpp src/Bounds.cpp src/MeshRegistry.cpp
+//       src/ObjLoader.cpp src/MeshCache.cpp src/MeshOptimizer.cpp src/MeshSimplifier.cpp src/CookedAssets.cpp
+//       src/VertexPacking.cpp src/Util.cpp src/Math.cpp src/stb_image.c -lGLEW -lGL -pthread
+
+#include "EntityBvh.h"
+#include "MeshRegistry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+// The shared loaders reference the renderer's GL object tables.
+MeshRegistry meshes;
+GLuint tex[NUM_TEXTURES];
+GLuint fbo[NUM_FRAMEBUFFERS];
+bool packedVertices = false;
+size_t streamingBudget = 0;
+bool cpuPicking = false;
+
+namespace
+{
+    const float ROOM_SIZE = 1000;
+    const int QUERY_COUNT = 1000;
+
+    double millisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    gl::Matrix4 randomView(std::mt19937 &random)
+    {
+        std::uniform_real_distribution<float> position(-ROOM_SIZE / 2, ROOM_SIZE / 2);
+        gl::Matrix4Stack projection;
+        projection.loadIdentity();
+        projection.prespective(45, 4.0f / 3, 0.01, 100);
+
+        gl::Matrix4Stack view;
+        view.loadIdentity();
+        gl::Vector3 eye(position(random), position(random), position(random));
+        gl::Vector3 target(position(random), position(random), position(random));
+        view.lookAt(eye, target, gl::Vector3(0, 1, 0));
+        return projection.top() * view.top();
+    }
+
+    void report(const char *name, double bvhMilliseconds, double scanMilliseconds, size_t results)
+    {
+        std::cout << name << " bvh: " << bvhMilliseconds << " ms scan: " << scanMilliseconds
+                  << " ms results: " << results << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t entityCount = argc > 1 ? std::strtoul(argv[1], 0, 10) : 100000;
+    std::mt19937 random(argc > 2 ? std::strtoul(argv[2], 0, 10) : 1);
+    std::uniform_real_distribution<float> position(-ROOM_SIZE / 2, ROOM_SIZE / 2);
+    std::uniform_real_distribution<float> angle(0, 360);
+    std::uniform_real_distribution<float> size(0.1f, 2);
+
+    MeshHandle cube = meshes.add("cube");
+    gl::Vector3 corners[2] = { gl::Vector3(-1, -1, -1), gl::Vector3(1, 1, 1) };
+    meshes[cube].bounds = computeBounds(corners, 2);
+
+    std::vector<Entity> entities(entityCount);
+    for (Entity &entity : entities)
+    {
+        entity.mesh = cube;
+        entity.translation = gl::Vector3(position(random), position(random), position(random));
+        entity.rotation = gl::Vector3(angle(random), angle(random), angle(random));
+        entity.scale = gl::Vector3(size(random), size(random), size(random));
+    }
+
+    EntityBvh bvh;
+    auto start = std::chrono::steady_clock::now();
+    bvh.build(entities);
+    std::cout << "Build entities: " << entityCount << " nodes: " << bvh.nodeCount()
+              << " time: " << millisecondsSince(start) << " ms" << std::endl;
+
+    // Nudge a few entities the way the editor does, then move every one
+    std::uniform_int_distribution<size_t> pick(0, entityCount - 1);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < QUERY_COUNT; ++i)
+    {
+        size_t index = pick(random);
+        entities[index].translation[0] += 0.1f;
+        bvh.refit(index, entities[index]);
+    }
+    std::cout << "Refit " << QUERY_COUNT << " entities: " << millisecondsSince(start) << " ms" << std::endl;
+
+    for (Entity &entity : entities)
+        entity.translation[1] += 1;
+    start = std::chrono::steady_clock::now();
+    bvh.refit(entities);
+    std::cout << "Refit all: " << millisecondsSince(start) << " ms" << std::endl;
+
+    std::vector<GLuint> visible;
+    std::vector<GLuint> expected;
+    double bvhMilliseconds = 0;
+    double scanMilliseconds = 0;
+    size_t results = 0;
+    for (int i = 0; i < QUERY_COUNT; ++i)
+    {
+        Frustum frustum = extractFrustum(randomView(random));
+        start = std::chrono::steady_clock::now();
+        bvh.cull(frustum, visible);
+        bvhMilliseconds += millisecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        expected.clear();
+        for (size_t e = 0; e < entityCount; ++e)
+        {
+            if (intersects(frustum, bvh.bounds(e)))
+                expected.push_back((GLuint) e);
+        }
+        scanMilliseconds += millisecondsSince(start);
+
+        if (visible != expected)
+            fatalError("Frustum query differs from the linear scan");
+        results += visible.size();
+    }
+    report("Frustum queries:", bvhMilliseconds, scanMilliseconds, results);
+
+    std::vector<RayHit> hits;
+    bvhMilliseconds = 0;
+    scanMilliseconds = 0;
+    results = 0;
+    for (int i = 0; i < QUERY_COUNT; ++i)
+    {
+        gl::Vector3 origin(position(random), position(random), position(random));
+        gl::Vector3 direction = gl::Vector3(position(random), position(random), position(random)) - origin;
+        start = std::chrono::steady_clock::now();
+        bvh.intersectRay(origin, direction, hits);
+        bvhMilliseconds += millisecondsSince(start);
+
+        // Brute force over every entity's box, as EntityBvh tests them
+        start = std::chrono::steady_clock::now();
+        size_t count = 0;
+        for (size_t e = 0; e < entityCount; ++e)
+        {
+            const Bounds &bounds = bvh.bounds(e);
+            float enter = 0;
+            float leave = 1e30f;
+            for (int c = 0; c < 3; ++c)
+            {
+                float t0 = (bounds.minimum[c] - origin[c]) / direction[c];
+                float t1 = (bounds.maximum[c] - origin[c]) / direction[c];
+                enter = std::max(enter, std::min(t0, t1));
+                leave = std::min(leave, std::max(t0, t1));
+            }
+            count += enter <= leave;
+        }
+        scanMilliseconds += millisecondsSince(start);
+
+        if (hits.size() != count)
+            fatalError("Ray query differs from the linear scan");
+        results += hits.size();
+    }
+    report("Ray queries:", bvhMilliseconds, scanMilliseconds, results);
+
+    return 0;
+}
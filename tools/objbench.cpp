@@ -0,0 +1,448 @@
+// objbench: first times parseFloat and parseInt against reading the same
+// lines through std::istringstream, the way LoadOBJ used to, and checks
+// every float against strtod to within one unit in the last place. Each
+// model in resources/models is then loaded with LoadOBJ and with a copy of
+// the stringstream loader it replaced, which must produce byte-identical
+// vertices. Last it writes a synthetic OBJ grid with the requested number of triangles and
+// times ParseOBJ and ParseIndexedOBJ over it with one worker thread and then
+// doubling up to threadCount. Every result is checked against the
+// single-threaded parse, which it must match exactly.
+//
+// Usage: objbench [faceCount] [threadCount] [output.obj]
+// Defaults to 2000000 faces, one thread per hardware thread and a file in
+// the working directory, which is removed afterwards unless it was named.
+// Build from the repository root together with the renderer sources, e.g.
+//   g++ -std=c++11 -O2 -Isrc tools/objbench.cpp src/ObjLoader.cpp src/MeshCache.cpp
+//       src/MeshOptimizer.cpp src/MeshSimplifier.cpp src/MeshRegistry.cpp src/Bounds.cpp
+//       src/TriangleBvh.cpp src/CookedAssets.cpp src/VertexPacking.cpp src/Util.cpp
+//       src/Math.cpp src/stb_image.c -lGLEW -lGL -pthread
+
+#include "MeshRegistry.h"
+#include "ObjLoader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+// The shared loaders reference the renderer's GL object tables.
+MeshRegistry meshes;
+GLuint tex[NUM_TEXTURES];
+GLuint fbo[NUM_FRAMEBUFFERS];
+bool packedVertices = false;
+size_t streamingBudget = 0;
+bool cpuPicking = false;
+
+namespace
+{
+    const size_t NUMBER_LINES = 1000000;
+    const int NUMBERS_PER_LINE = 3;
+
+    // The models are small, so each is loaded this many times per timing
+    const int MODEL_LOADS = 50;
+
+    const char *const MODELS[] =
+    {
+        "resources/models/chair.obj",
+        "resources/models/chest.obj",
+        "resources/models/cube.obj",
+        "resources/models/floor.obj",
+        "resources/models/shelves.obj",
+        "resources/models/skeleton.obj",
+        "resources/models/sphere.obj",
+        "resources/models/table.obj",
+        "resources/models/wall.obj"
+    };
+
+    double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // A rippled square grid of side quads, two triangles per quad, with
+    // every attribute indexed separately like an exported scan.
+    bool writeGrid(const std::string &filename, size_t side)
+    {
+        std::ofstream file(filename.c_str(), std::ios::binary);
+        if (!file)
+            return false;
+
+        std::string buffer;
+        char line[128];
+        size_t points = side + 1;
+        for (size_t z = 0; z < points; ++z)
+        {
+            for (size_t x = 0; x < points; ++x)
+            {
+                float u = (float) x / side;
+                float v = (float) z / side;
+                float height = 0.05f * std::sin(u * 40) * std::cos(v * 40);
+                int length = std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %.6f %.6f %.6f\n",
+                                           u * 100 - 50, height, v * 100 - 50, u, v, 0.0f, 1.0f, 0.0f);
+                buffer.append(line, length);
+            }
+            file << buffer;
+            buffer.clear();
+        }
+
+        for (size_t z = 0; z < side; ++z)
+        {
+            for (size_t x = 0; x < side; ++x)
+            {
+                size_t a = z * points + x + 1;
+                size_t b = a + 1;
+                size_t c = a + points;
+                size_t d = c + 1;
+                int length = std::snprintf(line, sizeof(line), "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\nf %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\n",
+                                           a, a, a, c, c, c, b, b, b, b, b, b, c, c, c, d, d, d);
+                buffer.append(line, length);
+            }
+            file << buffer;
+            buffer.clear();
+        }
+        return (bool) file;
+    }
+
+    // Distance between two floats in representable values
+    long long ulpDistance(float a, float b)
+    {
+        int32_t x, y;
+        std::memcpy(&x, &a, sizeof(x));
+        std::memcpy(&y, &b, sizeof(y));
+        long long orderedX = x < 0 ? (long long) INT32_MIN - x : x;
+        long long orderedY = y < 0 ? (long long) INT32_MIN - y : y;
+        return std::llabs(orderedX - orderedY);
+    }
+
+    // Mixes the fixed-point values exporters write with exponent forms and
+    // long mantissas that stress the rounding.
+    std::string randomFloatLines(std::mt19937 &random)
+    {
+        std::uniform_real_distribution<float> coordinate(-1000, 1000);
+        std::uniform_real_distribution<double> magnitude(-30, 30);
+        std::uniform_int_distribution<int> format(0, 3);
+
+        std::string text;
+        char number[64];
+        for (size_t i = 0; i < NUMBER_LINES; ++i)
+        {
+            text += "v";
+            for (int j = 0; j < NUMBERS_PER_LINE; ++j)
+            {
+                double value = std::pow(10.0, magnitude(random)) * (random() & 1 ? 1 : -1);
+                switch (format(random))
+                {
+                case 0: std::snprintf(number, sizeof(number), " %.6f", coordinate(random)); break;
+                case 1: std::snprintf(number, sizeof(number), " %.9g", value); break;
+                case 2: std::snprintf(number, sizeof(number), " %.6e", value); break;
+                default: std::snprintf(number, sizeof(number), " %.20g", value); break;
+                }
+                text += number;
+            }
+            text += "\n";
+        }
+        return text;
+    }
+
+    std::string randomIntLines(std::mt19937 &random)
+    {
+        std::uniform_int_distribution<int> index(-100000, 10000000);
+
+        std::string text;
+        char number[64];
+        for (size_t i = 0; i < NUMBER_LINES; ++i)
+        {
+            text += "f";
+            for (int j = 0; j < NUMBERS_PER_LINE; ++j)
+            {
+                std::snprintf(number, sizeof(number), " %d", index(random));
+                text += number;
+            }
+            text += "\n";
+        }
+        return text;
+    }
+
+    template <typename Number>
+    double parseLines(const std::string &text, std::vector<Number> &numbers,
+                      const char *(*parse)(const char *, const char *, Number &))
+    {
+        numbers.clear();
+        auto start = std::chrono::steady_clock::now();
+        const char *p = text.data();
+        const char *end = p + text.size();
+        while (p < end)
+        {
+            ++p;
+            for (int j = 0; j < NUMBERS_PER_LINE; ++j)
+            {
+                Number value = 0;
+                p = parse(p + 1, end, value);
+                numbers.push_back(value);
+            }
+            ++p;
+        }
+        return secondsSince(start);
+    }
+
+    template <typename Number>
+    double streamLines(const std::string &text, std::vector<Number> &numbers)
+    {
+        numbers.clear();
+        auto start = std::chrono::steady_clock::now();
+        std::istringstream file(text);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::stringstream stream(line);
+            std::string type;
+            stream >> type;
+            for (int j = 0; j < NUMBERS_PER_LINE; ++j)
+            {
+                Number value = 0;
+                stream >> value;
+                numbers.push_back(value);
+            }
+        }
+        return secondsSince(start);
+    }
+
+    void reportNumbers(const char *name, double seconds, double streamSeconds)
+    {
+        std::cout << name << " time: " << seconds * 1000 << " ms (" << NUMBER_LINES / seconds
+                  << " lines/s) speedup over stringstream: " << streamSeconds / seconds << "x" << std::endl;
+    }
+
+    bool benchmarkNumbers(std::mt19937 &random)
+    {
+        bool accurate = true;
+
+        std::string text = randomFloatLines(random);
+        std::vector<float> parsed, streamed;
+        double parseSeconds = parseLines(text, parsed, parseFloat);
+        double streamSeconds = streamLines(text, streamed);
+        reportNumbers("parseFloat", parseSeconds, streamSeconds);
+
+        const char *p = text.data();
+        long long worst = 0;
+        for (float value : parsed)
+        {
+            while (*p == 'v' || *p == ' ' || *p == '\n')
+                ++p;
+            char *next;
+            float expected = (float) std::strtod(p, &next);
+            long long distance = ulpDistance(value, expected);
+            if (distance > 1)
+            {
+                std::cerr << "parseFloat read '" << std::string(p, (const char *) next) << "' as " << value
+                          << ", strtod as " << expected << std::endl;
+                accurate = false;
+            }
+            worst = std::max(worst, distance);
+            p = next;
+        }
+        std::cout << "parseFloat worst error against strtod: " << worst << " ulp" << std::endl;
+
+        text = randomIntLines(random);
+        std::vector<int> parsedInts, streamedInts;
+        parseSeconds = parseLines(text, parsedInts, parseInt);
+        streamSeconds = streamLines(text, streamedInts);
+        reportNumbers("parseInt", parseSeconds, streamSeconds);
+        if (parsedInts != streamedInts)
+        {
+            std::cerr << "parseInt differs from stringstream" << std::endl;
+            accurate = false;
+        }
+
+        return accurate;
+    }
+
+    bool sameVertices(const std::vector<Vertex> &a, const std::vector<Vertex> &b)
+    {
+        return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(Vertex)) == 0);
+    }
+
+    // LoadOBJ as it was before the tokenizer, reading each line through a
+    // std::stringstream, without the log line
+    std::vector<Vertex> streamLoadOBJ(const std::string &filename, size_t &lineCount)
+    {
+        std::vector<Vertex> vertices;
+        lineCount = 0;
+
+        std::ifstream in(filename, std::ios::in);
+        if (in)
+        {
+            std::vector<gl::Vector3> positions;
+            std::vector<gl::Vector2> textureCoords;
+            std::vector<gl::Vector3> normals;
+
+            std::string line;
+            while (std::getline(in, line))
+            {
+                ++lineCount;
+                std::stringstream lineIn(line);
+                std::string token;
+                lineIn >> token;
+                if (token == "v")
+                {
+                    gl::Vector3 v;
+                    lineIn >> v[0] >> v[1] >> v[2];
+                    positions.push_back(v);
+                }
+                else if (token == "vt")
+                {
+                    gl::Vector2 vt;
+                    lineIn >> vt[0] >> vt[1];
+                    textureCoords.push_back(vt);
+                }
+                else if (token == "vn")
+                {
+                    gl::Vector3 vn;
+                    lineIn >> vn[0] >> vn[1] >> vn[2];
+                    normals.push_back(vn);
+                }
+                else if (token == "f")
+                {
+                    for (int i = 0; i < 3; ++i)
+                    {
+                        unsigned int v, vt, vn;
+                        char c;
+                        lineIn >> v >> c >> vt >> c >> vn;
+                        if (v <= positions.size() && vt <= textureCoords.size() && vn <= normals.size())
+                        {
+                            Vertex vertex;
+                            vertex.position = positions[v - 1];
+                            vertex.textureCoord = textureCoords[vt - 1];
+                            vertex.normal = normals[vn - 1];
+                            vertices.push_back(vertex);
+                        }
+                    }
+                }
+            }
+        }
+
+        if (vertices.size() == 0)
+            fatalError("Failed to load model '" + filename + "'");
+        return vertices;
+    }
+
+    bool benchmarkModels()
+    {
+        bool matched = true;
+        for (const char *filename : MODELS)
+        {
+            size_t lines = 0;
+            std::vector<Vertex> streamed;
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < MODEL_LOADS; ++i)
+                streamed = streamLoadOBJ(filename, lines);
+            double streamSeconds = secondsSince(start);
+
+            // LoadOBJ logs every load; keep that out of the report
+            std::ostringstream log;
+            std::streambuf *output = std::cout.rdbuf(log.rdbuf());
+            std::vector<Vertex> loaded;
+            start = std::chrono::steady_clock::now();
+            for (int i = 0; i < MODEL_LOADS; ++i)
+                loaded = LoadOBJ(filename);
+            double seconds = secondsSince(start);
+            std::cout.rdbuf(output);
+
+            bool same = sameVertices(loaded, streamed);
+            std::cout << "Model '" << filename << "' lines: " << lines << " vertices: " << loaded.size()
+                      << " stringstream: " << lines * MODEL_LOADS / streamSeconds << " lines/s LoadOBJ: "
+                      << lines * MODEL_LOADS / seconds << " lines/s speedup: " << streamSeconds / seconds << "x"
+                      << (same ? "" : " DIFFERS") << std::endl;
+            if (!same)
+            {
+                std::cerr << "LoadOBJ of '" << filename << "' differs from the stringstream loader" << std::endl;
+                matched = false;
+            }
+        }
+        return matched;
+    }
+
+    void report(const char *name, unsigned int threads, double seconds, double serialSeconds, size_t lines)
+    {
+        std::cout << name << " threads: " << threads << " time: " << seconds * 1000 << " ms ("
+                  << lines / seconds << " lines/s) speedup: " << serialSeconds / seconds << "x" << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t faceCount = argc > 1 ? std::strtoul(argv[1], 0, 10) : 2000000;
+    unsigned int threadCount = argc > 2 ? std::strtoul(argv[2], 0, 10) : 0;
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    std::string filename = argc > 3 ? argv[3] : "objbench.obj";
+
+    std::mt19937 random(1);
+    bool matched = benchmarkNumbers(random);
+    matched &= benchmarkModels();
+
+    size_t side = std::max<size_t>(1, (size_t) std::sqrt(faceCount / 2.0));
+    auto start = std::chrono::steady_clock::now();
+    if (!writeGrid(filename, side))
+    {
+        std::cerr << "Could not write '" << filename << "'" << std::endl;
+        return 1;
+    }
+
+    MappedFile file(filename);
+    if (!file.isOpen())
+    {
+        std::cerr << "Could not open '" << filename << "'" << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote " << side * side * 2 << " faces, " << file.size() << " bytes in "
+              << secondsSince(start) * 1000 << " ms" << std::endl;
+
+    size_t lines = 0;
+    start = std::chrono::steady_clock::now();
+    std::vector<Vertex> serial = ParseOBJ(file.begin(), file.end(), &lines, 1);
+    double serialSeconds = secondsSince(start);
+    report("ParseOBJ", 1, serialSeconds, serialSeconds, lines);
+
+    start = std::chrono::steady_clock::now();
+    MeshData serialIndexed = ParseIndexedOBJ(file.begin(), file.end(), 0, 1);
+    double serialIndexedSeconds = secondsSince(start);
+    report("ParseIndexedOBJ", 1, serialIndexedSeconds, serialIndexedSeconds, lines);
+
+    for (unsigned int threads = 2; threads < threadCount * 2; threads *= 2)
+    {
+        threads = std::min(threads, threadCount);
+
+        start = std::chrono::steady_clock::now();
+        std::vector<Vertex> vertices = ParseOBJ(file.begin(), file.end(), 0, threads);
+        report("ParseOBJ", threads, secondsSince(start), serialSeconds, lines);
+        if (!sameVertices(vertices, serial))
+        {
+            std::cerr << "ParseOBJ with " << threads << " threads differs from the serial parse" << std::endl;
+            matched = false;
+        }
+
+        start = std::chrono::steady_clock::now();
+        MeshData mesh = ParseIndexedOBJ(file.begin(), file.end(), 0, threads);
+        report("ParseIndexedOBJ", threads, secondsSince(start), serialIndexedSeconds, lines);
+        if (!sameVertices(mesh.vertices, serialIndexed.vertices) || mesh.indices != serialIndexed.indices)
+        {
+            std::cerr << "ParseIndexedOBJ with " << threads << " threads differs from the serial parse" << std::endl;
+            matched = false;
+        }
+    }
+
+    file.close();
+    if (argc <= 3)
+        std::remove(filename.c_str());
+
+    return matched ? 0 : 1;
+}
@@ -0,0 +1,258 @@
+// packcheck: packs sets of known vertices with packVertices, decodes them
+// again the way draw.vert and geometry_pass.vert do and checks the error
+// of every attribute against the PACKED_*_TOLERANCE bounds. The sets cover
+// axis, diagonal and fold-seam normals, texture coordinates far outside
+// [0, 1] and meshes with very large or degenerate extents. A set that must
+// exceed the bounds checks that the check itself fails. Exits non-zero if
+// any set does not behave as expected.
+//
+// Usage: packcheck [seed]
+// Build from the repository root, e.g.
+//   g++ -std=c++11 -O2 -Isrc tools/packcheck.cpp src/VertexPacking.cpp src/Math.cpp
+//       -lGLEW -lGL
+
+#include "VertexPacking.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+namespace
+{
+    struct KnownHalf
+    {
+        float value;
+        GLushort bits;
+    };
+
+    const KnownHalf KNOWN_HALVES[] =
+    {
+        { 0.0f, 0x0000 }, { -0.0f, 0x8000 }, { 1.0f, 0x3c00 }, { -2.0f, 0xc000 },
+        { 0.5f, 0x3800 }, { 65504.0f, 0x7bff }, { 5.9604645e-8f, 0x0001 }, { 6.1035156e-5f, 0x0400 }
+    };
+
+    struct Errors
+    {
+        Errors() : position(0), textureCoord(0), normal(0) {}
+
+        float position;
+        float textureCoord;
+        float normal;
+    };
+
+    // Mirrors decodeNormal in the vertex shaders
+    gl::Vector3 decodeNormal(const GLshort packed[2])
+    {
+        float x = packed[0] / 32767.0f;
+        float y = packed[1] / 32767.0f;
+        float z = 1 - std::fabs(x) - std::fabs(y);
+        if (z < 0)
+        {
+            float foldedX = (1 - std::fabs(y)) * (x >= 0 ? 1.0f : -1.0f);
+            float foldedY = (1 - std::fabs(x)) * (y >= 0 ? 1.0f : -1.0f);
+            x = foldedX;
+            y = foldedY;
+        }
+        gl::Vector3 normal(x, y, z);
+        return normal / normal.length();
+    }
+
+    Errors decodeErrors(const std::vector<Vertex> &vertices, const PackedMesh &mesh)
+    {
+        gl::Vector3 minimum = vertices[0].position;
+        gl::Vector3 maximum = minimum;
+        for (const Vertex &vertex : vertices)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                minimum[c] = std::min(minimum[c], vertex.position[c]);
+                maximum[c] = std::max(maximum[c], vertex.position[c]);
+            }
+        }
+        float extent = std::max(maximum[0] - minimum[0], std::max(maximum[1] - minimum[1], maximum[2] - minimum[2]));
+
+        Errors errors;
+        for (size_t i = 0; i < vertices.size(); ++i)
+        {
+            const Vertex &vertex = vertices[i];
+            const PackedVertex &packed = mesh.vertices[i];
+
+            for (int c = 0; c < 3; ++c)
+            {
+                float decoded = packed.position[c] * mesh.positionScale[c] + mesh.positionOffset[c];
+                float error = std::fabs(decoded - vertex.position[c]);
+                errors.position = std::max(errors.position, extent > 0 ? error / extent : error);
+            }
+
+            for (int c = 0; c < 2; ++c)
+            {
+                float decoded = halfToFloat(packed.textureCoord[c]);
+                float error = std::fabs(decoded - vertex.textureCoord[c]) / std::max(1.0f, std::fabs(vertex.textureCoord[c]));
+                errors.textureCoord = std::max(errors.textureCoord, std::isfinite(error) ? error : INFINITY);
+            }
+
+            float length = vertex.normal.length();
+            if (length > 0)
+            {
+                gl::Vector3 error = decodeNormal(packed.normal) - vertex.normal / length;
+                errors.normal = std::max(errors.normal, error.length());
+            }
+        }
+        return errors;
+    }
+
+    bool check(const char *name, const std::vector<Vertex> &vertices, bool withinTolerance = true)
+    {
+        PackedMesh mesh = packVertices(vertices.data(), vertices.size());
+        Errors errors = decodeErrors(vertices, mesh);
+
+        bool within = errors.position <= PACKED_POSITION_TOLERANCE &&
+                      errors.textureCoord <= PACKED_TEXTURE_COORD_TOLERANCE &&
+                      errors.normal <= PACKED_NORMAL_TOLERANCE;
+        bool passed = within == withinTolerance;
+        std::cout << (passed ? "ok   " : "FAIL ") << name << ": " << vertices.size() << " vertices, position "
+                  << errors.position << " texture coordinate " << errors.textureCoord
+                  << " normal " << errors.normal << (withinTolerance ? "" : " (expected above tolerance)") << std::endl;
+        return passed;
+    }
+
+    Vertex makeVertex(const gl::Vector3 &position, const gl::Vector2 &textureCoord, const gl::Vector3 &normal)
+    {
+        Vertex vertex;
+        vertex.position = position;
+        vertex.textureCoord = textureCoord;
+        vertex.normal = normal;
+        return vertex;
+    }
+
+    std::vector<Vertex> extremeNormals()
+    {
+        std::vector<gl::Vector3> normals;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            for (float sign = -1; sign <= 1; sign += 2)
+            {
+                gl::Vector3 normal(0, 0, 0);
+                normal[axis] = sign;
+                normals.push_back(normal);
+            }
+        }
+        for (int corner = 0; corner < 8; ++corner)
+            normals.push_back(gl::Vector3(corner & 1 ? 1 : -1, corner & 2 ? 1 : -1, corner & 4 ? 1 : -1));
+
+        // Just below the equator the octahedron folds over, and at -z the
+        // encoding sits on the corners of the square.
+        const float SEAM[] = { 0.0f, -0.0f, -1e-7f, -1e-4f, 1e-4f };
+        for (float z : SEAM)
+        {
+            normals.push_back(gl::Vector3(1, 0, z));
+            normals.push_back(gl::Vector3(-1, 1, z));
+            normals.push_back(gl::Vector3(0.3f, -0.7f, z));
+        }
+        normals.push_back(gl::Vector3(1e-6f, -1e-6f, -1));
+        normals.push_back(gl::Vector3(-1e-6f, 1e-6f, -1));
+
+        // Not unit length; the decoder only recovers the direction
+        normals.push_back(gl::Vector3(3, 4, 0));
+        normals.push_back(gl::Vector3(0, 0, -1e-20f));
+        normals.push_back(gl::Vector3(0, 0, 0));
+
+        std::vector<Vertex> vertices;
+        for (size_t i = 0; i < normals.size(); ++i)
+            vertices.push_back(makeVertex(gl::Vector3((float) i, (float) (i % 3), 0), gl::Vector2(0, 0), normals[i]));
+        return vertices;
+    }
+
+    std::vector<Vertex> randomNormals(std::mt19937 &random)
+    {
+        std::normal_distribution<float> direction;
+        std::uniform_real_distribution<float> position(-1, 1);
+        std::vector<Vertex> vertices(100000);
+        for (Vertex &vertex : vertices)
+        {
+            vertex = makeVertex(gl::Vector3(position(random), position(random), position(random)), gl::Vector2(0, 0),
+                                gl::Vector3(direction(random), direction(random), direction(random)));
+        }
+        return vertices;
+    }
+
+    std::vector<Vertex> wrappedTextureCoords(std::mt19937 &random)
+    {
+        const float KNOWN[] = { -1, 2, -3.5f, 17.25f, 1024.3f, -2048.7f, 65000, -65000, 1e-7f, -0.0f };
+        std::uniform_real_distribution<float> coordinate(-1000, 1000);
+
+        std::vector<Vertex> vertices;
+        for (float u : KNOWN)
+            for (float v : KNOWN)
+                vertices.push_back(makeVertex(gl::Vector3(u, v, 0), gl::Vector2(u, v), gl::Vector3(0, 0, 1)));
+        for (int i = 0; i < 100000; ++i)
+        {
+            gl::Vector2 textureCoord(coordinate(random), coordinate(random));
+            vertices.push_back(makeVertex(gl::Vector3((float) i, 0, 0), textureCoord, gl::Vector3(0, 1, 0)));
+        }
+        return vertices;
+    }
+
+    std::vector<Vertex> largeExtents(std::mt19937 &random, float extent)
+    {
+        std::uniform_real_distribution<float> position(-extent / 2, extent / 2);
+        std::vector<Vertex> vertices(100000);
+        for (Vertex &vertex : vertices)
+        {
+            vertex = makeVertex(gl::Vector3(position(random), position(random), position(random)),
+                                gl::Vector2(0, 0), gl::Vector3(0, 0, 1));
+        }
+        vertices[0].position = gl::Vector3(-extent / 2, -extent / 2, -extent / 2);
+        vertices[1].position = gl::Vector3(extent / 2, extent / 2, extent / 2);
+        return vertices;
+    }
+
+    std::vector<Vertex> flat(std::mt19937 &random)
+    {
+        std::vector<Vertex> vertices = largeExtents(random, 5000);
+        for (Vertex &vertex : vertices)
+            vertex.position[1] = 12.5f;
+        return vertices;
+    }
+
+    // Half floats overflow to infinity past 65504
+    std::vector<Vertex> overflowingTextureCoords()
+    {
+        std::vector<Vertex> vertices;
+        vertices.push_back(makeVertex(gl::Vector3(0, 0, 0), gl::Vector2(0, 0), gl::Vector3(0, 0, 1)));
+        vertices.push_back(makeVertex(gl::Vector3(1, 1, 1), gl::Vector2(1e6f, 0), gl::Vector3(0, 0, 1)));
+        return vertices;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::mt19937 random(argc > 1 ? std::strtoul(argv[1], 0, 10) : 1);
+    bool passed = true;
+
+    for (const KnownHalf &known : KNOWN_HALVES)
+    {
+        GLushort bits = floatToHalf(known.value);
+        if (bits != known.bits || halfToFloat(bits) != known.value)
+        {
+            std::cout << "FAIL half float " << known.value << ": encoded " << std::hex << bits
+                      << " expected " << known.bits << std::dec << std::endl;
+            passed = false;
+        }
+    }
+
+    passed &= check("extreme normals", extremeNormals());
+    passed &= check("random normals", randomNormals(random));
+    passed &= check("texture coordinates outside [0, 1]", wrappedTextureCoords(random));
+    passed &= check("extent 1e-3", largeExtents(random, 1e-3f));
+    passed &= check("extent 1e5", largeExtents(random, 1e5f));
+    passed &= check("extent 1e30", largeExtents(random, 1e30f));
+    passed &= check("flat", flat(random));
+    passed &= check("single vertex", std::vector<Vertex>(1, makeVertex(gl::Vector3(7, -3, 1e4f), gl::Vector2(2, -1), gl::Vector3(0, -1, 0))));
+    passed &= check("texture coordinates past half range", overflowingTextureCoords(), false);
+
+    std::cout << (passed ? "All packing checks passed" : "Packing checks failed") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,144 @@
+
+// raybench: casts random rays at meshes through MeshRegistry::raycast and
+// reports millions of rays per second, checking a sample of the hits
+// against a plain loop over every triangle. Exits non-zero if any sampled
+// hit differs.
+//
+// Usage: raybench [rayCount] [model.obj...]
+// Defaults to 1000000 rays at resources/models/skeleton.obj and sphere.obj.
+// Build from the repository root together with the renderer sources, e.g.
+//   g++ -std=c++11 -O2 -Isrc tools/raybench.cpp src/TriangleBvh.cpp src/Bounds.cpp src/MeshRegistry.cpp
+//       src/ObjLoader.cpp src/MeshCache.cpp src/MeshOptimizer.cpp src/MeshSimplifier.cpp src/CookedAssets.cpp
+//       src/VertexPacking.cpp src/Util.cpp src/Math.cpp src/stb_image.c -lGLEW -lGL -pthread
+
+#include "MeshRegistry.h"
+#include "ObjLoader.h"
+
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+// The shared loaders reference the renderer's GL object tables.
+MeshRegistry meshes;
+GLuint tex[NUM_TEXTURES];
+GLuint fbo[NUM_FRAMEBUFFERS];
+bool packedVertices = false;
+size_t streamingBudget = 0;
+bool cpuPicking = false;
+
+namespace
+{
+    const size_t CHECKED_RAYS = 10000;
+
+    double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Reference Moller-Trumbore over every triangle, without culling
+    float intersectAll(const MeshData &mesh, const Ray &ray)
+    {
+        float nearest = ray.maxDistance;
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+        {
+            const gl::Vector3 &a = mesh.vertices[mesh.indices[i]].position;
+            gl::Vector3 edge1 = mesh.vertices[mesh.indices[i + 1]].position - a;
+            gl::Vector3 edge2 = mesh.vertices[mesh.indices[i + 2]].position - a;
+            gl::Vector3 p = gl::cross(ray.direction, edge2);
+            float det = gl::dot(edge1, p);
+            if (det == 0)
+                continue;
+
+            gl::Vector3 s = ray.origin - a;
+            gl::Vector3 q = gl::cross(s, edge1);
+            float u = gl::dot(s, p) / det;
+            float v = gl::dot(ray.direction, q) / det;
+            float t = gl::dot(edge2, q) / det;
+            if (u >= 0 && v >= 0 && u + v <= 1 && t >= 0 && t < nearest)
+                nearest = t;
+        }
+        return nearest < ray.maxDistance ? nearest : -1;
+    }
+
+    // Returns the number of sampled rays whose hit differs from the loop
+    size_t benchmark(const std::string &filename, size_t rayCount, std::mt19937 &random)
+    {
+        MeshData data = LoadIndexedOBJ(filename);
+        std::vector<gl::Vector3> positions(data.vertices.size());
+        for (size_t i = 0; i < positions.size(); ++i)
+            positions[i] = data.vertices[i].position;
+
+        MeshHandle mesh = meshes.add(filename);
+        auto start = std::chrono::steady_clock::now();
+        meshes[mesh].triangles.build(positions, data.indices);
+        double buildSeconds = secondsSince(start);
+
+        // Rays from a sphere around the mesh towards points inside its box
+        Bounds bounds = computeBounds(&positions[0], positions.size());
+        gl::Vector3 center(bounds.sphere);
+        std::normal_distribution<float> normal;
+        std::uniform_real_distribution<float> unit(0, 1);
+        std::vector<Ray> rays(rayCount);
+        for (Ray &ray : rays)
+        {
+            gl::Vector3 away(normal(random), normal(random), normal(random));
+            ray.origin = center + away / away.length() * bounds.sphere[3] * 2;
+            gl::Vector3 target;
+            for (int c = 0; c < 3; ++c)
+                target[c] = bounds.minimum[c] + (bounds.maximum[c] - bounds.minimum[c]) * unit(random);
+            ray.direction = target - ray.origin;
+            ray.maxDistance = FLT_MAX;
+        }
+
+        size_t hits = 0;
+        std::vector<float> distances(rayCount);
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < rayCount; ++i)
+        {
+            TriangleHit hit;
+            distances[i] = meshes.raycast(mesh, rays[i], hit) ? hit.distance : -1;
+            hits += distances[i] >= 0;
+        }
+        double raySeconds = secondsSince(start);
+
+        size_t checked = std::min(CHECKED_RAYS, rayCount);
+        size_t mismatches = 0;
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < checked; ++i)
+        {
+            float expected = intersectAll(data, rays[i]);
+            if ((expected < 0) != (distances[i] < 0) || std::fabs(expected - distances[i]) > 1e-5f * std::max(1.0f, expected))
+                mismatches++;
+        }
+        double loopSeconds = secondsSince(start);
+
+        std::cout << "Mesh '" << filename << "' triangles: " << meshes[mesh].triangles.triangleCount()
+                  << " nodes: " << meshes[mesh].triangles.nodeCount() << " build: " << buildSeconds * 1000 << " ms" << std::endl;
+        std::cout << "  BVH: " << rayCount / raySeconds / 1e6 << " Mrays/s hits: " << hits
+                  << " loop: " << checked / loopSeconds / 1e6 << " Mrays/s mismatches: " << mismatches
+                  << " / " << checked << std::endl;
+        return mismatches;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t rayCount = argc > 1 ? std::strtoul(argv[1], 0, 10) : 1000000;
+    std::vector<std::string> models;
+    for (int i = 2; i < argc; ++i)
+        models.push_back(argv[i]);
+    if (models.empty())
+    {
+        models.push_back("resources/models/skeleton.obj");
+        models.push_back("resources/models/sphere.obj");
+    }
+
+    std::mt19937 random(1);
+    size_t mismatches = 0;
+    for (const std::string &model : models)
+        mismatches += benchmark(model, rayCount, random);
+    return mismatches ? 1 : 0;
+}